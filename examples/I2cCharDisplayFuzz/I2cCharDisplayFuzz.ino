@@ -0,0 +1,370 @@
+/*
+  Important NOTES:
+    1. If using Arduino IDE, version 1.5.0 or higher is REQUIRED!
+    2. The display must be readable (the lcd backpack has to connect the read/write pin of the lcd).
+*/
+
+/*
+  I2cCharDisplayFuzz.ino
+
+  Versions
+    1.1.0 - 10/18/2026
+      Original release.
+
+  Short Description:
+
+      This program checks the library on a real display. It makes random sequences of
+      library calls (print, cursorMove, clear, custom characters, shifts, entry modes, ...)
+      from a seed, and runs each sequence twice from the same starting state:
+
+        1. in reference mode (setReferenceMode(true)), where every command and character
+           is sent in its own i2c transmission, the way the library first did it.
+        2. with the optimized transfers (bulk writes, batched commands, skipped cells).
+
+      After each run, the DDRAM and CGRAM of the display are read back (readDisplayMemory())
+      and verifyDisplay() checks them against what the library thinks it sent. The two runs
+      have to leave the display the same, and the optimized run must not use more i2c
+      transmissions than the reference run (i2cTransactions()).
+
+      When a seed fails, calls are removed from the sequence one at a time as long as it
+      still fails, and the seed and the smallest failing sequence are printed to Serial
+      (9600 baud), so that it can be repeated with runSeed().
+
+      Marquees, layers, animations, fields, charsets and fades are checked on a computer by
+      the I2cCharDisplayFuzz program in the extras folder, which runs the library against
+      emulated displays (and compares the entry mode, display control and display shift too).
+
+
+  https://www.dcity.org/portfolio/i2c-display-library/
+
+
+  This program is public domain. You may use it for any purpose.
+    NO WARRANTY IS IMPLIED.
+
+  License Information:  https://www.dcity.org/license-information/
+*/
+
+
+// include files... some boards require different include files
+#ifdef ARDUINO_ARCH_AVR         // if using an arduino
+#include "I2cCharDisplay.h"
+#include "Wire.h"
+#elif ARDUINO_ARCH_SAM        // if using an arduino DUE
+#include "I2cCharDisplay.h"
+#include "Wire.h"
+#elif PARTICLE                     // if using a core, photon, or electron (by particle.io)
+#include "I2cCharDisplay/I2cCharDisplay.h"  // use this if the library files are in the particle repository of libraries
+//#include "I2cCharDisplay.h"     // use this if the library files are in the same folder as this demo program
+#elif defined(__MK20DX128__) || (__MK20DX256__) || (__MK20DX256__) || (__MK62FX512__) || (__MK66FX1M0__) // if using a teensy 3.0, 3.1, 3.2, 3.5, 3.6
+#include "I2cCharDisplay.h"
+#include "Wire.h"
+#else                           // if using something else then this may work
+#include "I2cCharDisplay.h"
+#include "Wire.h"
+#endif
+
+
+#define DISPLAYTYPE    LCD_TYPE                // LCD_TYPE, OLED_TYPE or LCD_MCP23017_TYPE
+#define DISPLAYADDRESS 0x27                    // i2c address of the display (0x3c for the oled, 0x20 for an MCP23017 backpack)
+#define DISPLAYROWS    2                       // number of rows in the display
+
+#define MAXOPS         24                      // longest sequence of library calls
+#define OPTYPES        15                      // number of kinds of library calls (see runOp())
+
+I2cCharDisplay display(DISPLAYTYPE, DISPLAYADDRESS, DISPLAYROWS);
+
+uint32_t seed = 1;                             // the next seed to test
+uint32_t randomState;                          // state of the xorshift random numbers
+uint32_t ops[MAXOPS];                          // the sequence being tested
+uint8_t opCount;
+uint16_t failures = 0;
+
+// what the display held after the reference run
+uint8_t referenceDdram[DISPLAY_DDRAM_SIZE];
+uint8_t referenceCgram[DISPLAY_CGRAM_SIZE];
+
+
+void setup()
+{
+  Serial.begin(9600);
+  Wire.begin();                     // initialize i2c
+  display.begin();                  // initialize the display
+  display.setProbeInterval(0);      // no hot plug checks, they would add i2c transmissions to one of the runs
+}
+
+
+void loop()
+{
+  if (!runSeed(seed))
+  {
+    failures++;
+  }
+  if (seed % 100 == 0)
+  {
+    Serial.print(F("seeds: "));
+    Serial.print(seed);
+    Serial.print(F("  failures: "));
+    Serial.println(failures);
+  }
+  seed++;
+}
+
+
+// xorshift random numbers (the same seed always gives the same sequence)
+uint32_t nextRandom()
+{
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+
+// make the sequence for a seed and test it, returns false (and prints the smallest failing sequence) if it fails
+bool runSeed(uint32_t testSeed)
+{
+  randomState = testSeed * 2654435761UL | 1;     // spread the seeds out (the state can't be 0)
+  opCount = 1 + nextRandom() % MAXOPS;
+  for (uint8_t i = 0; i < opCount; ++i)
+  {
+    ops[i] = nextRandom();
+  }
+
+  if (runBoth())
+  {
+    return true;
+  }
+
+  // remove calls one at a time, as long as the sequence still fails
+  uint8_t i = 0;
+  while (i < opCount && opCount > 1)
+  {
+    uint32_t removed = ops[i];
+    for (uint8_t j = i; j + 1 < opCount; ++j)
+    {
+      ops[j] = ops[j + 1];
+    }
+    opCount--;
+    if (!runBoth())
+    {
+      continue;                     // still fails without it
+    }
+    for (uint8_t j = opCount; j > i; --j)   // it is needed, put it back
+    {
+      ops[j] = ops[j - 1];
+    }
+    ops[i] = removed;
+    opCount++;
+    i++;
+  }
+
+  Serial.print(F("FAIL seed "));
+  Serial.print(testSeed);
+  Serial.print(F(", "));
+  Serial.print(opCount);
+  Serial.println(F(" calls:"));
+  for (i = 0; i < opCount; ++i)
+  {
+    printOp(ops[i]);
+  }
+  return false;
+}
+
+
+// run the sequence in reference mode and optimized, returns true if both leave the same (verified) display
+bool runBoth()
+{
+  uint8_t ddram[DISPLAY_DDRAM_SIZE];
+  uint8_t cgram[DISPLAY_CGRAM_SIZE];
+  uint32_t referenceTransactions;
+  uint32_t optimizedTransactions;
+  bool ok;
+
+  referenceTransactions = runOps(true);
+  ok = display.verifyDisplay() && display.readDisplayMemory(referenceDdram, referenceCgram);
+
+  optimizedTransactions = runOps(false);
+  ok = ok && display.verifyDisplay() && display.readDisplayMemory(ddram, cgram);
+
+  return ok &&
+         memcmp(ddram, referenceDdram, DISPLAY_DDRAM_SIZE) == 0 &&
+         memcmp(cgram, referenceCgram, DISPLAY_CGRAM_SIZE) == 0 &&
+         optimizedTransactions <= referenceTransactions;
+}
+
+
+// put the display in the same state, run the sequence, and return the number of i2c transmissions it used
+uint32_t runOps(bool reference)
+{
+  uint8_t blank[8][8];
+
+  display.setReferenceMode(true);
+  memset(blank, 0, sizeof(blank));
+  display.createCharacters(blank, 0, 8);
+  display.displayLeftToRight();
+  display.displayShiftOff();
+  display.displayOn();
+  display.cursorOff();
+  display.cursorBlinkOff();
+  display.clear();
+
+  display.setReferenceMode(reference);
+  uint32_t start = display.i2cTransactions();
+  for (uint8_t i = 0; i < opCount; ++i)
+  {
+    runOp(ops[i]);
+  }
+  return display.i2cTransactions() - start;
+}
+
+
+// make one library call, the kind is op % OPTYPES and its values come from the other bits of op
+void runOp(uint32_t op)
+{
+  uint8_t a = op >> 8;
+  uint8_t b = op >> 16;
+  char text[41];
+  uint8_t length;
+
+  switch (op % OPTYPES)
+  {
+  case 0:
+    display.cursorMove(1 + a % DISPLAYROWS, 1 + b % 20);
+    break;
+
+  case 1:                           // a short string
+    length = 1 + a % 8;
+    for (uint8_t i = 0; i < length; ++i)
+    {
+      text[i] = 'A' + (b + i * 7) % 58;
+    }
+    text[length] = 0;
+    display.print(text);
+    break;
+
+  case 2:
+    display.clear();
+    break;
+
+  case 3:
+    display.home();
+    break;
+
+  case 4:
+  {
+    uint8_t map[8];
+    for (uint8_t i = 0; i < 8; ++i)
+    {
+      map[i] = (a * (i + 3) + b) & 0x1F;
+    }
+    display.createCharacter(a % 8, map);
+    break;
+  }
+
+  case 5:
+  {
+    uint8_t maps[3][8];
+    for (uint8_t c = 0; c < 3; ++c)
+    {
+      for (uint8_t i = 0; i < 8; ++i)
+      {
+        maps[c][i] = (b + c * 11 + i * 5) & 0x1F;
+      }
+    }
+    display.createCharacters(maps, a % 6, 1 + b % 3);
+    break;
+  }
+
+  case 6:                           // a custom character
+    display.write((uint8_t)(a % 8));
+    break;
+
+  case 7:
+    if (a & 1)
+      display.displayShiftLeft();
+    else
+      display.displayShiftRight();
+    break;
+
+  case 8:
+    if (a & 1)
+      display.cursorShiftLeft();
+    else
+      display.cursorShiftRight();
+    break;
+
+  case 9:
+    if (a % 4 == 0)
+      display.displayRightToLeft();
+    else
+      display.displayLeftToRight();
+    break;
+
+  case 10:
+    if (a % 4 == 0)
+      display.displayShiftOn();
+    else
+      display.displayShiftOff();
+    break;
+
+  case 11:
+    switch (a % 6)
+    {
+    case 0:  display.cursorOn();       break;
+    case 1:  display.cursorOff();      break;
+    case 2:  display.cursorBlinkOn();  break;
+    case 3:  display.cursorBlinkOff(); break;
+    case 4:  display.displayOff();     break;
+    default: display.displayOn();      break;
+    }
+    break;
+
+  case 12:
+    if (DISPLAYTYPE == OLED_TYPE)
+      display.setBrightness(a);
+    break;
+
+  case 13:                          // a cell through the isr queue (sent by update(), if DISPLAY_QUEUE_SIZE is turned on in I2cCharDisplay.h)
+    display.isrSetCell(1 + a % DISPLAYROWS, 1 + b % 20, 'a' + b % 26);
+    display.update();
+    break;
+
+  default:                          // a long string (past the end of a line)
+    length = 16 + a % 24;
+    for (uint8_t i = 0; i < length; ++i)
+    {
+      text[i] = '0' + (b + i) % 40;
+    }
+    text[length] = 0;
+    display.print(text);
+    break;
+  }
+}
+
+
+// print the kind of call and its 2 values
+void printOp(uint32_t op)
+{
+  switch (op % OPTYPES)
+  {
+  case 0:  Serial.print(F("  cursorMove"));        break;
+  case 1:  Serial.print(F("  print short"));       break;
+  case 2:  Serial.print(F("  clear"));             break;
+  case 3:  Serial.print(F("  home"));              break;
+  case 4:  Serial.print(F("  createCharacter"));   break;
+  case 5:  Serial.print(F("  createCharacters"));  break;
+  case 6:  Serial.print(F("  write custom"));      break;
+  case 7:  Serial.print(F("  displayShift"));      break;
+  case 8:  Serial.print(F("  cursorShift"));       break;
+  case 9:  Serial.print(F("  entry direction"));   break;
+  case 10: Serial.print(F("  entry shift"));       break;
+  case 11: Serial.print(F("  display control"));   break;
+  case 12: Serial.print(F("  setBrightness"));     break;
+  case 13: Serial.print(F("  isrSetCell"));        break;
+  default: Serial.print(F("  print long"));        break;
+  }
+  Serial.print(F(" a="));
+  Serial.print((uint8_t)(op >> 8));
+  Serial.print(F(" b="));
+  Serial.println((uint8_t)(op >> 16));
+}
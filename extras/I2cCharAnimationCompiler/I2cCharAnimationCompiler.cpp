@@ -0,0 +1,471 @@
+/*
+  I2cCharAnimationCompiler.cpp
+
+  Short Description:
+
+      This program runs on a computer (not on the microcontroller). It reads a text file
+      that describes the frames of an animation (a boot splash, a spinner, etc.) and writes
+      the animation in the compact format that I2cCharDisplay::animationStart() plays.
+
+      Only the characters that change from one frame to the next are kept, so playing
+      a frame costs the microcontroller (and the i2c bus) very little.
+
+      Build it with any C++11 compiler, e.g.
+          g++ -O2 -o I2cCharAnimationCompiler I2cCharAnimationCompiler.cpp
+
+      Usage:
+          I2cCharAnimationCompiler [-n name] [-o output] [-b] [-s] input.txt
+
+          -n name     name of the array in the header file (default: the name of the input file)
+          -o output   write to this file (default: standard output)
+          -b          write the animation as binary, instead of a header file
+          -s          print the size of the animation (to standard error)
+
+      After the animation is made, it is played back by this program and compared to the
+      frames of the input file. If they don't match, nothing is written and the exit code is 2.
+
+
+  Input file:
+
+      # lines that start with # are comments
+      size 2 16                  rows and columns of the animation (required, before the first frame)
+      glyph 0 00000 01010 ...    custom character 0-7: 8 rows of 5 pixels, in binary (e.g. 01010)
+                                 or hex (e.g. 0x0a). A glyph is sent with the next frame.
+      frame 100                  start a frame that is shown for 100 ms, followed by one line for
+      |Loading        |          each row. Each row starts with | and the text can end with | (so
+      |\0\1\2          |          that trailing blanks can be seen). Blanks are added to short rows.
+
+      Escapes in the text of a row:  \0 - \7  custom characters 0-7
+                                     \xHH     the character code HH (hex)
+                                     \\  \|   a \ or a |
+
+  The animation format is described with the ANIMATION_ constants in I2cCharDisplay.h.
+
+  License Information:  https://www.dcity.org/license-information/
+*/
+
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+
+// the animation format (the same values as in I2cCharDisplay.h)
+#define ANIMATION_MAGIC1             'C'
+#define ANIMATION_MAGIC2             'A'
+#define ANIMATION_VERSION            1
+#define ANIMATION_HEADERSIZE         5
+#define ANIMATION_END                0x00
+#define ANIMATION_GLYPHS             0x01
+#define ANIMATION_CELLS              0x02
+#define ANIMATION_FRAME              0x03
+
+#define MAX_ROWS                     4
+#define MAX_COLUMNS                  40
+#define GAP_TO_MERGE                 3      // unchanged characters that are cheaper to send than a new cells record
+
+
+struct Glyph
+{
+  bool defined;
+  uint8_t rows[8];
+};
+
+struct Frame
+{
+  uint16_t time;                             // ms to show the frame
+  std::vector<std::string> text;             // one string of cols characters for each row
+  Glyph glyphs[8];                           // the custom characters when this frame is shown
+};
+
+
+static const char *inputName = "";
+static int lineNumber = 0;
+
+
+static void fail(const char *message)
+{
+  fprintf(stderr, "%s:%d: %s\n", inputName, lineNumber, message);
+  exit(1);
+}
+
+
+static int hexValue(char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  fail("bad hex digit");
+  return 0;
+}
+
+
+// change the text of a row (after the first |) into character codes
+static std::string parseRow(const char *text, int cols)
+{
+  std::string row;
+  size_t length = strlen(text);
+
+  while (length > 0 && (text[length - 1] == '\n' || text[length - 1] == '\r'))
+    length--;
+
+  for (size_t i = 0; i < length; ++i)
+  {
+    char c = text[i];
+    if (c == '|' && i == length - 1)         // the optional | at the end (a \| before it is taken by the escape)
+      break;
+    if (c == '\\' && i + 1 < length)
+    {
+      c = text[++i];
+      if (c >= '0' && c <= '7')
+        row += (char)(c - '0');
+      else if (c == 'x' && i + 2 < length)
+      {
+        row += (char)(hexValue(text[i + 1]) * 16 + hexValue(text[i + 2]));
+        i += 2;
+      }
+      else if (c == '\\' || c == '|')
+        row += c;
+      else
+        fail("unknown escape");
+    }
+    else
+      row += c;
+  }
+  if ((int)row.size() > cols)
+    fail("row is longer than the number of columns");
+  row.resize(cols, ' ');
+  return row;
+}
+
+
+static uint8_t parseGlyphRow(const char *word)
+{
+  if (word[0] == '0' && (word[1] == 'x' || word[1] == 'X'))
+    return (uint8_t)strtoul(word + 2, NULL, 16);
+  if (strlen(word) != 5 || strspn(word, "01") != 5)
+    fail("glyph rows are 5 binary digits (e.g. 01010) or hex (e.g. 0x0a)");
+  return (uint8_t)strtoul(word, NULL, 2);
+}
+
+
+static void readInput(FILE *file, int &rows, int &cols, std::vector<Frame> &frames)
+{
+  char line[512];
+  Glyph glyphs[8];
+  int rowsNeeded = 0;
+
+  memset(glyphs, 0, sizeof(glyphs));
+  rows = 0;
+  cols = 0;
+
+  while (fgets(line, sizeof(line), file))
+  {
+    lineNumber++;
+    if (rowsNeeded > 0)
+    {
+      if (line[0] != '|')
+        fail("each row of a frame starts with |");
+      frames.back().text.push_back(parseRow(line + 1, cols));
+      rowsNeeded--;
+      continue;
+    }
+
+    char *word = strtok(line, " \t\r\n");
+    if (word == NULL || word[0] == '#')
+      continue;
+
+    if (strcmp(word, "size") == 0)
+    {
+      char *r = strtok(NULL, " \t\r\n");
+      char *c = strtok(NULL, " \t\r\n");
+      if (r == NULL || c == NULL)
+        fail("size needs rows and columns");
+      rows = atoi(r);
+      cols = atoi(c);
+      if (rows < 1 || rows > MAX_ROWS || cols < 1 || cols > MAX_COLUMNS)
+        fail("size is 1-4 rows and 1-40 columns");
+    }
+    else if (strcmp(word, "glyph") == 0)
+    {
+      char *n = strtok(NULL, " \t\r\n");
+      if (n == NULL || atoi(n) < 0 || atoi(n) > 7)
+        fail("glyph needs a number 0-7");
+      Glyph &glyph = glyphs[atoi(n)];
+      for (int i = 0; i < 8; ++i)
+      {
+        char *value = strtok(NULL, " \t\r\n");
+        if (value == NULL)
+          fail("glyph needs 8 rows");
+        glyph.rows[i] = parseGlyphRow(value);
+      }
+      glyph.defined = true;
+    }
+    else if (strcmp(word, "frame") == 0)
+    {
+      char *time = strtok(NULL, " \t\r\n");
+      if (rows == 0)
+        fail("size is needed before the first frame");
+      if (time == NULL || atol(time) < 0 || atol(time) > 65535)
+        fail("frame needs a time of 0-65535 ms");
+      Frame frame;
+      frame.time = (uint16_t)atol(time);
+      memcpy(frame.glyphs, glyphs, sizeof(glyphs));
+      frames.push_back(frame);
+      rowsNeeded = rows;
+    }
+    else
+      fail("unknown line (expected size, glyph or frame)");
+  }
+  if (rowsNeeded > 0)
+    fail("the last frame is missing rows");
+  if (frames.empty())
+    fail("there are no frames");
+}
+
+
+static void addCells(std::vector<uint8_t> &out, int row, const std::string &text, int start, int end)
+{
+  out.push_back(ANIMATION_CELLS);
+  out.push_back((uint8_t)(row + 1));
+  out.push_back((uint8_t)(start + 1));
+  out.push_back((uint8_t)(end - start));
+  for (int i = start; i < end; ++i)
+    out.push_back((uint8_t)text[i]);
+}
+
+
+// The first frame has all of its glyphs and characters (the display could show anything when the
+// animation starts or repeats), the other frames only have what changed from the frame before.
+static std::vector<uint8_t> compile(int rows, int cols, const std::vector<Frame> &frames)
+{
+  std::vector<uint8_t> out;
+
+  out.push_back(ANIMATION_MAGIC1);
+  out.push_back(ANIMATION_MAGIC2);
+  out.push_back(ANIMATION_VERSION);
+  out.push_back((uint8_t)rows);
+  out.push_back((uint8_t)cols);
+
+  for (size_t f = 0; f < frames.size(); ++f)
+  {
+    const Frame &frame = frames[f];
+    const Frame *previous = (f == 0) ? NULL : &frames[f - 1];
+
+    // glyphs that changed, in runs of glyph numbers that are next to each other
+    int g = 0;
+    while (g < 8)
+    {
+      bool changed = frame.glyphs[g].defined &&
+        (previous == NULL || memcmp(frame.glyphs[g].rows, previous->glyphs[g].rows, 8) != 0 || !previous->glyphs[g].defined);
+      if (!changed)
+      {
+        g++;
+        continue;
+      }
+      int first = g;
+      while (g < 8 && frame.glyphs[g].defined &&
+             (previous == NULL || memcmp(frame.glyphs[g].rows, previous->glyphs[g].rows, 8) != 0 || !previous->glyphs[g].defined))
+        g++;
+      out.push_back(ANIMATION_GLYPHS);
+      out.push_back((uint8_t)first);
+      out.push_back((uint8_t)(g - first));
+      for (int i = first; i < g; ++i)
+        out.insert(out.end(), frame.glyphs[i].rows, frame.glyphs[i].rows + 8);
+    }
+
+    // characters that changed
+    for (int r = 0; r < rows; ++r)
+    {
+      const std::string &text = frame.text[r];
+      if (previous == NULL)
+      {
+        addCells(out, r, text, 0, cols);
+        continue;
+      }
+      const std::string &before = previous->text[r];
+      int c = 0;
+      while (c < cols)
+      {
+        if (text[c] == before[c])
+        {
+          c++;
+          continue;
+        }
+        int start = c;
+        int end = c + 1;
+        int same = 0;
+        for (int i = c + 1; i < cols && same <= GAP_TO_MERGE; ++i)
+        {
+          if (text[i] == before[i])
+            same++;
+          else
+          {
+            same = 0;
+            end = i + 1;
+          }
+        }
+        addCells(out, r, text, start, end);
+        c = end;
+      }
+    }
+
+    out.push_back(ANIMATION_FRAME);
+    out.push_back((uint8_t)(frame.time & 0xFF));
+    out.push_back((uint8_t)(frame.time >> 8));
+  }
+  out.push_back(ANIMATION_END);
+  return out;
+}
+
+
+// Play the animation (twice, to check that it repeats correctly) and compare each frame
+// with the input. The screen starts out unknown (0xFF) to make sure that the first frame sets everything.
+static bool verify(const std::vector<uint8_t> &animation, int rows, int cols, const std::vector<Frame> &frames)
+{
+  uint8_t screen[MAX_ROWS][MAX_COLUMNS];
+  uint8_t cgram[8][8];
+  memset(screen, 0xFF, sizeof(screen));
+  memset(cgram, 0xFF, sizeof(cgram));
+
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    size_t p = ANIMATION_HEADERSIZE;
+    size_t f = 0;
+    for (;;)
+    {
+      if (p >= animation.size())
+        return false;
+      uint8_t record = animation[p++];
+      if (record == ANIMATION_END)
+        break;
+      if (record == ANIMATION_GLYPHS)
+      {
+        int first = animation[p++];
+        int count = animation[p++];
+        for (int i = 0; i < count; ++i, p += 8)
+          memcpy(cgram[first + i], &animation[p], 8);
+      }
+      else if (record == ANIMATION_CELLS)
+      {
+        int row = animation[p++] - 1;
+        int col = animation[p++] - 1;
+        int count = animation[p++];
+        for (int i = 0; i < count; ++i)
+          screen[row][col + i] = animation[p++];
+      }
+      else if (record == ANIMATION_FRAME)
+      {
+        if (f >= frames.size())
+          return false;
+        const Frame &frame = frames[f];
+        uint16_t time = animation[p] | (animation[p + 1] << 8);
+        p += 2;
+        if (time != frame.time)
+          return false;
+        for (int r = 0; r < rows; ++r)
+          if (memcmp(screen[r], frame.text[r].data(), cols) != 0)
+            return false;
+        for (int g = 0; g < 8; ++g)
+          if (frame.glyphs[g].defined && memcmp(cgram[g], frame.glyphs[g].rows, 8) != 0)
+            return false;
+        f++;
+      }
+      else
+        return false;
+    }
+    if (f != frames.size())
+      return false;
+  }
+  return true;
+}
+
+
+static void usage()
+{
+  fprintf(stderr, "usage: I2cCharAnimationCompiler [-n name] [-o output] [-b] [-s] input.txt\n");
+  exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+  std::string name;
+  const char *outputName = NULL;
+  bool binary = false;
+  bool sizes = false;
+
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; ++i)
+  {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      name = argv[++i];
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      outputName = argv[++i];
+    else if (strcmp(argv[i], "-b") == 0)
+      binary = true;
+    else if (strcmp(argv[i], "-s") == 0)
+      sizes = true;
+    else
+      usage();
+  }
+  if (i != argc - 1)
+    usage();
+  inputName = argv[i];
+
+  FILE *input = fopen(inputName, "r");
+  if (input == NULL)
+  {
+    perror(inputName);
+    return 1;
+  }
+  int rows, cols;
+  std::vector<Frame> frames;
+  readInput(input, rows, cols, frames);
+  fclose(input);
+
+  std::vector<uint8_t> animation = compile(rows, cols, frames);
+  if (!verify(animation, rows, cols, frames))
+  {
+    fprintf(stderr, "%s: the animation did not play back the same as the input\n", inputName);
+    return 2;
+  }
+  if (sizes)
+    fprintf(stderr, "%s: %d frames, %d bytes (%d bytes without the deltas)\n", inputName, (int)frames.size(),
+            (int)animation.size(), (int)(ANIMATION_HEADERSIZE + frames.size() * (rows * (4 + cols) + 3) + 1));
+
+  if (name.empty())                          // use the input file name, without the folders and extension
+  {
+    const char *start = strrchr(inputName, '/');
+    name = start ? start + 1 : inputName;
+    name = name.substr(0, name.find('.'));
+    for (size_t j = 0; j < name.size(); ++j)
+      if (!isalnum((unsigned char)name[j]))
+        name[j] = '_';
+  }
+
+  FILE *output = outputName ? fopen(outputName, binary ? "wb" : "w") : stdout;
+  if (output == NULL)
+  {
+    perror(outputName);
+    return 1;
+  }
+  if (binary)
+    fwrite(animation.data(), 1, animation.size(), output);
+  else
+  {
+    fprintf(output, "// made by I2cCharAnimationCompiler from %s\n", inputName);
+    fprintf(output, "// play it with:  myDisplay.animationStart(%s, true);\n\n", name.c_str());
+    fprintf(output, "const uint8_t %s[] PROGMEM = {", name.c_str());
+    for (size_t j = 0; j < animation.size(); ++j)
+      fprintf(output, "%s0x%02X", (j % 12 == 0) ? (j ? ",\n  " : "\n  ") : ", ", animation[j]);
+    fprintf(output, "\n};\n");
+  }
+  if (outputName)
+    fclose(output);
+  return 0;
+}
@@ -0,0 +1,62 @@
+/*
+  Arduino.h
+
+  Short Description:
+
+      The part of the Arduino core that I2cCharDisplay uses, for building the library on a computer
+      with I2cCharDisplayFuzz (see I2cCharDisplayFuzz.cpp).
+
+      The clocks are not real time, they are moved by the library waits and by the fuzz program:
+        - micros() is the time of the i2c bus and the display controller. It is moved by delay(),
+          delayMicroseconds() and by every byte on the i2c bus (see DisplayEmulator.h).
+        - millis() is the time of the sketch. It is only moved by the fuzz program (between the library
+          calls), so that update() steps marquees, animations and fades at the same times in the
+          reference run and in the optimized run, even though the optimized run spends less time
+          on the i2c bus.
+
+  License Information:  https://www.dcity.org/license-information/
+*/
+
+#ifndef ARDUINO_H_HOST
+#define ARDUINO_H_HOST
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef bool boolean;
+
+#define DEC 10
+#define HEX 16
+
+extern unsigned long hostMicros;   // time of the i2c bus and the display controller (us)
+extern unsigned long hostMillis;   // time of the sketch (ms)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void noInterrupts();
+void interrupts();
+
+
+// the Print class of the Arduino core (only the functions that the library and the fuzz program use)
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str) { return (str == NULL) ? 0 : write((const uint8_t *)str, strlen(str)); }
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+
+  size_t print(const char *str) { return write(str); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(int value, int base = DEC) { return print((long)value, base); }
+  size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t println() { return write("\r\n"); }
+  size_t println(const char *str) { return print(str) + println(); }
+};
+
+#endif
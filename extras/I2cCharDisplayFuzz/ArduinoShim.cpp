@@ -0,0 +1,146 @@
+/*
+  ArduinoShim.cpp
+
+  Short Description:
+
+      The Arduino core functions and the Wire class of Arduino.h and Wire.h (in this folder), for
+      building I2cCharDisplay on a computer with I2cCharDisplayFuzz.
+
+  License Information:  https://www.dcity.org/license-information/
+*/
+
+
+#include <stdio.h>
+#include "Arduino.h"
+#include "Wire.h"
+#include "DisplayEmulator.h"
+
+
+unsigned long hostMicros = 0;
+unsigned long hostMillis = 0;
+
+TwoWire Wire;
+
+
+unsigned long millis()
+{
+  return hostMillis;
+}
+
+
+unsigned long micros()
+{
+  return hostMicros;
+}
+
+
+void delay(unsigned long ms)
+{
+  hostMicros += ms * 1000;
+}
+
+
+void delayMicroseconds(unsigned int us)
+{
+  hostMicros += us;
+}
+
+
+void noInterrupts()
+{
+}
+
+
+void interrupts()
+{
+}
+
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--)
+  {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+
+size_t Print::print(long value, int base)
+{
+  if (base == DEC && value < 0)
+  {
+    return print('-') + print((unsigned long)-value, base);
+  }
+  return print((unsigned long)value, base);
+}
+
+
+size_t Print::print(unsigned long value, int base)
+{
+  char text[33];
+
+  snprintf(text, sizeof(text), (base == HEX) ? "%lX" : "%lu", value);
+  return write(text);
+}
+
+
+void TwoWire::begin()
+{
+}
+
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+  _address    = address;
+  _txCount    = 0;
+  _txOverflow = false;
+}
+
+
+size_t TwoWire::write(uint8_t data)
+{
+  if (_txCount >= WIRE_BUFFER_SIZE)
+  {
+    _txOverflow = true;
+    return 0;
+  }
+  _txBuffer[_txCount++] = data;
+  return 1;
+}
+
+
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+  (void)sendStop;
+  if (_txOverflow)                  // the Wire library would have dropped the end of the transmission
+  {
+    emulator.addError();
+  }
+  return emulator.transmission(_address, _txBuffer, _txCount) ? 0 : 2;
+}
+
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t count)
+{
+  if (count > WIRE_BUFFER_SIZE)
+  {
+    count = WIRE_BUFFER_SIZE;
+  }
+  _rxCount = emulator.request(address, _rxBuffer, count);
+  _rxIndex = 0;
+  return _rxCount;
+}
+
+
+int TwoWire::available()
+{
+  return _rxCount - _rxIndex;
+}
+
+
+int TwoWire::read()
+{
+  return (_rxIndex < _rxCount) ? _rxBuffer[_rxIndex++] : -1;
+}
@@ -0,0 +1,640 @@
+/*
+  DisplayEmulator.cpp
+
+  Short Description:
+
+      The display emulator of I2cCharDisplayFuzz, see DisplayEmulator.h.
+
+  License Information:  https://www.dcity.org/license-information/
+*/
+
+
+#include "DisplayEmulator.h"
+#include "I2cCharDisplay.h"
+
+
+DisplayEmulator emulator;
+
+
+// ********************************************** public functions ********************************************
+
+
+void DisplayEmulator::powerOn(uint8_t displayType, uint8_t i2cAddress, uint8_t rows, uint8_t fill)
+{
+  memset(_state.ddram, fill, sizeof(_state.ddram));
+  memset(_state.cgram, fill, sizeof(_state.cgram));
+  _state.addressCounter = 0;
+  _state.addressIsCgram = false;
+  _state.entryMode      = LCD_DISPLAYLEFTTORIGHT;
+  _state.displayControl = 0;
+  _state.displayShift   = 0;
+  _state.backlight      = false;
+  _state.brightness     = 0x7F;     // US2066 reset value
+  _state.fade           = 0;
+
+  _displayType   = displayType;
+  _i2cAddress    = i2cAddress;
+  _rows          = rows;
+  _attached      = true;
+  _busyUntil     = hostMicros;
+
+  _eightBitMode  = true;
+  _nibblePending = false;
+  _highNibble    = 0;
+  _readValue     = 0xFF;
+  _pcaPort       = 0xFF;            // the PCA8574 outputs are high after power up
+  _readWritePin  = true;
+  _glitch        = false;
+
+  memset(_mcpRegisters, 0, sizeof(_mcpRegisters));
+  _mcpRegisters[MCP23017_IODIRA] = 0xFF;
+  _mcpRegisters[MCP23017_IODIRB] = 0xFF;
+  _mcpPointer = 0;
+
+  _oledExtended      = false;
+  _oledOledCommands  = false;
+  _oledParameter     = 0;
+  _oledDataParameter = false;
+  _oledReadData      = false;
+}
+
+
+void DisplayEmulator::unplug()
+{
+  _attached = false;
+}
+
+
+void DisplayEmulator::glitch()
+{
+  _glitch = true;
+}
+
+
+void DisplayEmulator::setReadWritePin(bool connected)
+{
+  _readWritePin = connected;
+}
+
+
+void DisplayEmulator::setBusyTimes(uint16_t command, uint16_t data, uint16_t clear)
+{
+  _commandTime = command;
+  _dataTime    = data;
+  _clearTime   = clear;
+}
+
+
+bool DisplayEmulator::transmission(uint8_t address, const uint8_t *data, uint8_t count)
+{
+  _transactions++;
+  hostMicros += EMULATOR_BYTE_TIME;
+  if (!_attached || address != _i2cAddress)
+  {
+    return false;
+  }
+  if (_glitch)
+  {
+    _glitch = false;
+    return false;
+  }
+
+  switch (_displayType)
+  {
+  case LCD_TYPE:
+    for (uint8_t i = 0; i < count; ++i)
+    {
+      hostMicros += EMULATOR_BYTE_TIME;
+      pcaWrite(data[i]);
+    }
+    break;
+
+  case LCD_MCP23017_TYPE:
+    if (count > 0)
+    {
+      hostMicros += EMULATOR_BYTE_TIME;
+      _mcpPointer = data[0];
+      if (_mcpPointer >= sizeof(_mcpRegisters))
+      {
+        _errors++;
+        _mcpPointer = 0;
+      }
+    }
+    for (uint8_t i = 1; i < count; ++i)
+    {
+      hostMicros += EMULATOR_BYTE_TIME;
+      mcpWrite(data[i]);
+    }
+    break;
+
+  case OLED_TYPE:
+  {
+    uint8_t i = 0;
+    while (i < count)
+    {
+      uint8_t control = data[i++];
+      hostMicros += EMULATOR_BYTE_TIME;
+      if ((control & ~(OLED_COMMANDMODE | OLED_DATAMODE)) != 0)
+      {
+        _errors++;
+      }
+      _oledReadData = (control & OLED_DATAMODE);
+      if (control & OLED_COMMANDMODE)     // Co = 1: one byte, then another control byte
+      {
+        if (i < count)
+        {
+          hostMicros += EMULATOR_BYTE_TIME;
+          oledByte(control & OLED_DATAMODE, data[i++]);
+        }
+      }
+      else                                // Co = 0: the rest of the transmission
+      {
+        while (i < count)
+        {
+          hostMicros += EMULATOR_BYTE_TIME;
+          oledByte(control & OLED_DATAMODE, data[i++]);
+        }
+      }
+    }
+    break;
+  }
+
+  default:
+    break;
+  }
+  return true;
+}
+
+
+uint8_t DisplayEmulator::request(uint8_t address, uint8_t *data, uint8_t count)
+{
+  _transactions++;
+  hostMicros += EMULATOR_BYTE_TIME;
+  if (!_attached || address != _i2cAddress)
+  {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    hostMicros += EMULATOR_BYTE_TIME;
+    switch (_displayType)
+    {
+    case LCD_TYPE:                  // the PCA8574 inputs: low where the output is low, or where the lcd drives low
+      data[i] = _pcaPort;
+      if (_readWritePin && (_pcaPort & (LCD_READ | LCD_ENABLEON)) == (LCD_READ | LCD_ENABLEON))
+      {
+        data[i] &= _readValue | 0x0F;
+      }
+      break;
+
+    case LCD_MCP23017_TYPE:
+      data[i] = mcpRead();
+      break;
+
+    default:                        // OLED_TYPE
+      if (_oledReadData)
+      {
+        if (busy())
+        {
+          _lost++;
+          data[i] = 0xFF;
+        }
+        else
+        {
+          data[i] = readData();
+        }
+      }
+      else
+      {
+        data[i] = readStatus();
+      }
+      break;
+    }
+  }
+  return count;
+}
+
+
+const DisplayState &DisplayEmulator::state()
+{
+  return _state;
+}
+
+
+uint32_t DisplayEmulator::transactions()
+{
+  return _transactions;
+}
+
+
+uint32_t DisplayEmulator::lost()
+{
+  return _lost;
+}
+
+
+uint32_t DisplayEmulator::errors()
+{
+  return _errors;
+}
+
+
+void DisplayEmulator::addError()
+{
+  _errors++;
+}
+
+
+void DisplayEmulator::excuse(uint32_t lostCount, uint32_t errorCount)
+{
+  _lost   -= lostCount;
+  _errors -= errorCount;
+}
+
+
+// ********************************************** private functions ********************************************
+
+
+void DisplayEmulator::execute(bool data, uint8_t value)
+{
+  if (busy())
+  {
+    _lost++;
+    return;
+  }
+  if (data)
+  {
+    writeData(value);
+    _busyUntil = hostMicros + _dataTime;
+  }
+  else
+  {
+    command(value);
+    _busyUntil = hostMicros + ((value == LCD_CLEARDISPLAYCOMMAND || (value & 0xFE) == LCD_RETURNHOMECOMMAND) ? _clearTime : _commandTime);
+  }
+}
+
+
+void DisplayEmulator::command(uint8_t value)
+{
+  if (value & LCD_SETDDRAMADDRCOMMAND)
+  {
+    _state.addressCounter = value & 0x7F;
+    _state.addressIsCgram = false;
+  }
+  else if (value & LCD_SETCGRAMADDRCOMMAND)
+  {
+    _state.addressCounter = value & 0x3F;
+    _state.addressIsCgram = true;
+  }
+  else if (value & LCD_FUNCTIONSETCOMMAND)
+  {
+    _eightBitMode = (_displayType == LCD_MCP23017_TYPE) || (value & LCD_8BITMODE);
+  }
+  else if (value & LCD_SHIFTCOMMAND)
+  {
+    if (value & LCD_DISPLAYSHIFT)
+    {
+      shiftDisplay(!(value & LCD_SHIFTRIGHT));
+    }
+    else
+    {
+      advance(value & LCD_SHIFTRIGHT);
+    }
+  }
+  else if (value & LCD_DISPLAYCONTROLCOMMAND)
+  {
+    _state.displayControl = value & 0x07;
+  }
+  else if (value & LCD_ENTRYMODECOMMAND)
+  {
+    _state.entryMode = value & 0x03;
+  }
+  else if (value & LCD_RETURNHOMECOMMAND)
+  {
+    _state.addressCounter = 0;
+    _state.addressIsCgram = false;
+    _state.displayShift   = 0;
+  }
+  else if (value & LCD_CLEARDISPLAYCOMMAND)
+  {
+    memset(_state.ddram, ' ', sizeof(_state.ddram));
+    _state.addressCounter = 0;
+    _state.addressIsCgram = false;
+    _state.displayShift   = 0;
+    _state.entryMode     |= LCD_DISPLAYLEFTTORIGHT;
+  }
+}
+
+
+void DisplayEmulator::writeData(uint8_t value)
+{
+  bool increment = _state.entryMode & LCD_DISPLAYLEFTTORIGHT;
+
+  if (_state.addressIsCgram)
+  {
+    _state.cgram[_state.addressCounter] = value;
+  }
+  else
+  {
+    _state.ddram[_state.addressCounter] = value;
+    if (_state.entryMode & LCD_DISPLAYSHIFTON)
+    {
+      shiftDisplay(increment);
+    }
+  }
+  advance(increment);
+}
+
+
+uint8_t DisplayEmulator::readData()
+{
+  uint8_t value = _state.addressIsCgram ? _state.cgram[_state.addressCounter] : _state.ddram[_state.addressCounter];
+
+  advance(_state.entryMode & LCD_DISPLAYLEFTTORIGHT);
+  _busyUntil = hostMicros + _dataTime;
+  return value;
+}
+
+
+uint8_t DisplayEmulator::readStatus()
+{
+  return (busy() ? 0x80 : 0x00) | _state.addressCounter;
+}
+
+
+// the address counter skips the DDRAM addresses that the display doesn't have (like ddramAddressUsed() in the library)
+void DisplayEmulator::advance(bool increment)
+{
+  uint8_t &address = _state.addressCounter;
+
+  if (_state.addressIsCgram)
+  {
+    address = (address + (increment ? 1 : -1)) & 0x3F;
+  }
+  else if (_rows > 2 && _displayType == OLED_TYPE)
+  {
+    address = (address + (increment ? 1 : -1)) & 0x7F;
+  }
+  else if (_rows == 1)
+  {
+    if (increment)
+      address = (address >= 0x4F) ? 0x00 : address + 1;
+    else
+      address = (address == 0x00) ? 0x4F : address - 1;
+  }
+  else if (increment)
+  {
+    if (address == 0x27)
+      address = 0x40;
+    else if (address >= 0x67)
+      address = 0x00;
+    else
+      address++;
+  }
+  else
+  {
+    if (address == 0x40)
+      address = 0x27;
+    else if (address == 0x00)
+      address = 0x67;
+    else
+      address--;
+  }
+}
+
+
+void DisplayEmulator::shiftDisplay(bool left)
+{
+  _state.displayShift = (_state.displayShift + (left ? 1 : EMULATOR_SHIFT_RANGE - 1)) % EMULATOR_SHIFT_RANGE;
+}
+
+
+bool DisplayEmulator::busy()
+{
+  return (long)(hostMicros - _busyUntil) < 0;
+}
+
+
+// PCA8574: RS, RW, E and the backlight on P0-P3, the lcd data pins D4-D7 on P4-P7
+// (without the read/write pin, the lcd always writes)
+void DisplayEmulator::pcaWrite(uint8_t value)
+{
+  uint8_t before = _readWritePin ? _pcaPort : (_pcaPort & ~LCD_READ);
+  bool rs = value & LCD_DATA;
+  uint8_t nibble = value >> 4;
+
+  _pcaPort         = value;
+  _state.backlight = value & LCD_BACKLIGHTON;
+  if (!_readWritePin)
+  {
+    value &= ~LCD_READ;
+  }
+
+  if (!(before & LCD_ENABLEON) && (value & LCD_ENABLEON) && (value & LCD_READ))  // a read starts when enable goes high
+  {
+    if (_eightBitMode || !_nibblePending)
+    {
+      if (rs && busy())
+      {
+        _lost++;
+        _highNibble = 0xFF;
+      }
+      else
+      {
+        _highNibble = rs ? readData() : readStatus();   // keep the whole byte for the second nibble
+      }
+      _readValue     = _highNibble & 0xF0;
+      _nibblePending = !_eightBitMode;
+    }
+    else
+    {
+      _readValue     = _highNibble << 4;
+      _nibblePending = false;
+    }
+  }
+  else if ((before & LCD_ENABLEON) && !(value & LCD_ENABLEON) && !(before & LCD_READ))   // a write is taken when enable goes low
+  {
+    if (_eightBitMode)              // D0-D3 aren't connected
+    {
+      execute(rs, nibble << 4);
+    }
+    else if (!_nibblePending)
+    {
+      _highNibble    = nibble;
+      _nibblePending = true;
+    }
+    else
+    {
+      _nibblePending = false;
+      execute(rs, (_highNibble << 4) | nibble);
+    }
+  }
+}
+
+
+// MCP23017: RS, RW, E and the backlight on GPA0-GPA3, the lcd data pins D0-D7 on GPB0-GPB7
+void DisplayEmulator::mcpWrite(uint8_t value)
+{
+  uint8_t reg = _mcpPointer;
+  uint8_t before = _mcpRegisters[MCP23017_OLATA];
+
+  if (reg == MCP23017_IOCON || reg == MCP23017_IOCON + 1)     // both addresses are IOCON
+  {
+    _mcpRegisters[MCP23017_IOCON]     = value;
+    _mcpRegisters[MCP23017_IOCON + 1] = value;
+    if (value & ~MCP23017_SEQOP)      // the library only uses IOCON.BANK = 0
+    {
+      _errors++;
+    }
+  }
+  else if (reg == MCP23017_GPIOA || reg == MCP23017_GPIOB)    // writing GPIO writes the output latch
+  {
+    _mcpRegisters[reg + 2] = value;
+  }
+  else
+  {
+    _mcpRegisters[reg] = value;
+  }
+  if (reg == MCP23017_GPIOA || reg == MCP23017_OLATA)
+  {
+    mcpPins(before);
+  }
+  mcpNextRegister();
+}
+
+
+uint8_t DisplayEmulator::mcpRead()
+{
+  uint8_t reg = _mcpPointer;
+  uint8_t value;
+
+  if (reg == MCP23017_GPIOA || reg == MCP23017_GPIOB)
+  {
+    uint8_t direction = _mcpRegisters[reg - MCP23017_GPIOA];
+    uint8_t inputs = 0xFF;          // nothing drives the inputs
+    if (reg == MCP23017_GPIOB &&
+        (_mcpRegisters[MCP23017_OLATA] & (LCD_READ | LCD_ENABLEON)) == (LCD_READ | LCD_ENABLEON))
+    {
+      inputs = _readValue;          // the lcd drives the data pins
+    }
+    value = (inputs & direction) | (_mcpRegisters[reg + 2] & ~direction);
+  }
+  else
+  {
+    value = _mcpRegisters[reg];
+  }
+  mcpNextRegister();
+  return value;
+}
+
+
+// IOCON.SEQOP = 1 (byte mode) toggles between the A and B register of a pair
+void DisplayEmulator::mcpNextRegister()
+{
+  if (_mcpRegisters[MCP23017_IOCON] & MCP23017_SEQOP)
+  {
+    _mcpPointer ^= 1;
+  }
+  else
+  {
+    _mcpPointer = (_mcpPointer + 1) % sizeof(_mcpRegisters);
+  }
+}
+
+
+void DisplayEmulator::mcpPins(uint8_t before)
+{
+  uint8_t pins = _mcpRegisters[MCP23017_OLATA];
+  bool rs = pins & LCD_DATA;
+
+  _state.backlight = pins & LCD_BACKLIGHTON;
+  if (!(before & LCD_ENABLEON) && (pins & LCD_ENABLEON) && (pins & LCD_READ))
+  {
+    if (rs && busy())
+    {
+      _lost++;
+      _readValue = 0xFF;
+    }
+    else
+    {
+      _readValue = rs ? readData() : readStatus();
+    }
+  }
+  else if ((before & LCD_ENABLEON) && !(pins & LCD_ENABLEON) && !(before & LCD_READ))
+  {
+    if (_mcpRegisters[MCP23017_IODIRB] != 0x00)     // the data pins aren't outputs
+    {
+      _errors++;
+    }
+    execute(rs, _mcpRegisters[MCP23017_OLATA + 1]);
+  }
+}
+
+
+// US2066: the HD44780 commands, and the extended (RE = 1) and oled (SD = 1) commands that the library uses
+void DisplayEmulator::oledByte(bool data, uint8_t value)
+{
+  if (data)
+  {
+    if (_oledDataParameter)         // the parameter of function selection A or B
+    {
+      _oledDataParameter = false;
+      return;
+    }
+    execute(true, value);
+    return;
+  }
+
+  if (_oledParameter != 0)
+  {
+    if (_oledParameter == OLED_SETBRIGHTNESSCOMMAND)
+    {
+      _state.brightness = value;
+    }
+    else if (_oledParameter == OLED_SETFADECOMMAND)
+    {
+      _state.fade = value;
+    }
+    _oledParameter = 0;
+    return;
+  }
+
+  if (!_oledExtended && !_oledOledCommands && (value & 0xE0) != LCD_FUNCTIONSETCOMMAND)
+  {
+    execute(false, value);
+    return;
+  }
+
+  if (busy())
+  {
+    _lost++;
+    return;
+  }
+  _busyUntil = hostMicros + _commandTime;
+  if (_oledOledCommands)
+  {
+    if ((value & 0xFE) == 0x78)     // oled characterization, SD = 0 or 1
+    {
+      _oledOledCommands = value & 1;
+    }
+    else if (value == OLED_SETBRIGHTNESSCOMMAND || value == OLED_SETFADECOMMAND ||
+             value == 0xD5 || value == 0xD9 || value == 0xDA || value == 0xDB || value == 0xDC)
+    {
+      _oledParameter = value;
+    }
+  }
+  else if ((value & 0xE0) == LCD_FUNCTIONSETCOMMAND)
+  {
+    _oledExtended = value & 0x02;
+  }
+  else if ((value & 0xFE) == 0x78)
+  {
+    _oledOledCommands = value & 1;
+  }
+  else if (value == 0x71 || value == 0x72)    // function selection A or B, the parameter is sent as data
+  {
+    _oledDataParameter = true;
+  }
+}
@@ -0,0 +1,121 @@
+/*
+  DisplayEmulator.h
+
+  Short Description:
+
+      An emulator of the displays that I2cCharDisplay drives, on the i2c bus of the host Wire class:
+
+        - an HD44780 lcd on a PCA8574 backpack (LCD_TYPE), in 4 bit mode
+        - an HD44780 lcd on an MCP23017 backpack (LCD_MCP23017_TYPE), in 8 bit mode
+        - a US2066 oled (OLED_TYPE)
+
+      It keeps everything that the display shows: the DDRAM and CGRAM, the address counter, the entry
+      mode, the display control bits, the display shift, and the backlight (lcd) or brightness (oled).
+
+      The controller is busy for a while after each command and character (see setBusyTimes()). What is
+      written (or read) while it is busy is lost, like on a real display, and counted in lost().
+      Every byte on the i2c bus takes 25us (400kHz).
+
+  License Information:  https://www.dcity.org/license-information/
+*/
+
+#ifndef DISPLAYEMULATOR_H
+#define DISPLAYEMULATOR_H
+
+#include <stdint.h>
+
+#define EMULATOR_DDRAM_SIZE   128
+#define EMULATOR_CGRAM_SIZE   64
+#define EMULATOR_SHIFT_RANGE  40    // the display shift wraps after 40 characters
+#define EMULATOR_BYTE_TIME    25    // us to send one byte on the i2c bus (400kHz)
+
+
+// what the display shows (compared between the runs of I2cCharDisplayFuzz)
+struct DisplayState
+{
+  uint8_t ddram[EMULATOR_DDRAM_SIZE];
+  uint8_t cgram[EMULATOR_CGRAM_SIZE];
+  uint8_t addressCounter;
+  bool addressIsCgram;
+  uint8_t entryMode;               // I/D and S bits of the last entry mode command
+  uint8_t displayControl;          // D, C and B bits of the last display control command
+  uint8_t displayShift;            // characters that the display is shifted to the left (0 - 39)
+  bool backlight;                  // lcd backlight
+  uint8_t brightness;              // oled contrast
+  uint8_t fade;                    // oled fade out and blinking setting
+};
+
+
+class DisplayEmulator
+{
+public:
+
+  void powerOn(uint8_t displayType, uint8_t i2cAddress, uint8_t rows, uint8_t fill);  // a display that was just powered on, fill is in its DDRAM and CGRAM until it is cleared
+  void unplug();                                                     // the display stops acknowledging until the next powerOn()
+  void glitch();                                                     // the next transmission isn't acknowledged (a glitch on the bus)
+  void setReadWritePin(bool connected);                              // false for a PCA8574 backpack that doesn't connect the lcd read/write pin (until the next powerOn())
+  void setBusyTimes(uint16_t command, uint16_t data, uint16_t clear); // us that the controller is busy after a command, a character, and clear (or home)
+  bool transmission(uint8_t address, const uint8_t *data, uint8_t count);  // an i2c write, returns false if it isn't acknowledged
+  uint8_t request(uint8_t address, uint8_t *data, uint8_t count);   // an i2c read, returns the number of bytes read
+  const DisplayState &state();                                       // what the display shows
+  uint32_t transactions();                                           // i2c writes and reads (acknowledged or not)
+  uint32_t lost();                                                   // commands, characters and reads that came while the controller was busy
+  uint32_t errors();                                                 // transmissions that the display can't understand (e.g. longer than the Wire buffer)
+  void addError();
+  void excuse(uint32_t lostCount, uint32_t errorCount);             // take back lost commands and errors that were expected (e.g. writes to a display that was just reset)
+
+private:
+
+  // the controller (HD44780, or the HD44780 commands of the US2066)
+  void execute(bool data, uint8_t value);   // a command or a character, if the controller isn't busy
+  void command(uint8_t value);
+  void writeData(uint8_t value);
+  uint8_t readData();            // the character at the address counter, and move the address counter
+  uint8_t readStatus();          // busy flag and address counter
+  void advance(bool increment);  // move the address counter
+  void shiftDisplay(bool left);
+  bool busy();
+
+  // the interfaces
+  void pcaWrite(uint8_t value);  // PCA8574 output port
+  void mcpWrite(uint8_t value);  // MCP23017 register write (at the register pointer)
+  uint8_t mcpRead();
+  void mcpNextRegister();
+  void mcpPins(uint8_t before);  // the lcd pins of port A changed
+  void oledByte(bool data, uint8_t value);
+
+  DisplayState _state;
+  uint8_t _displayType;
+  uint8_t _i2cAddress;
+  uint8_t _rows;
+  bool _attached;
+  uint32_t _transactions;
+  uint32_t _lost;
+  uint32_t _errors;
+
+  uint16_t _commandTime;
+  uint16_t _dataTime;
+  uint16_t _clearTime;
+  unsigned long _busyUntil;      // hostMicros when the controller can take the next command
+
+  bool _eightBitMode;            // lcd interface width (set by the function set command)
+  bool _nibblePending;           // 4 bit mode: the high nibble of a write (or read) is done
+  uint8_t _highNibble;
+  uint8_t _readValue;            // what the lcd drives on the data pins during a read
+  uint8_t _pcaPort;              // PCA8574 outputs
+  bool _readWritePin;            // the PCA8574 connects the lcd read/write pin
+  bool _glitch;                  // the next transmission isn't acknowledged
+
+  uint8_t _mcpRegisters[0x16];   // MCP23017 registers (IOCON.BANK = 0)
+  uint8_t _mcpPointer;
+
+  bool _oledExtended;            // US2066 RE bit (extended instruction set)
+  bool _oledOledCommands;        // US2066 SD bit (oled command set)
+  uint8_t _oledParameter;        // oled command that waits for its parameter (0 if none)
+  bool _oledDataParameter;       // function selection A or B waits for its parameter (sent as data)
+  bool _oledReadData;            // the last control byte was for data (a read returns DDRAM or CGRAM)
+};
+
+extern DisplayEmulator emulator;
+
+#endif
@@ -0,0 +1,1600 @@
+/*
+  I2cCharDisplayFuzz.cpp
+
+  Short Description:
+
+      This program runs on a computer (not on the microcontroller). It builds I2cCharDisplay with the
+      Arduino and Wire classes in this folder, and runs it on emulated displays (see DisplayEmulator.h):
+      HD44780 lcds on a PCA8574 and on an MCP23017 backpack, and US2066 oleds.
+
+      It makes random sequences of library calls from a seed: the calls of examples/I2cCharDisplayFuzz,
+      and marquees, layers and compose(), animations, fields, setCharset() and mapCharacter(),
+      fadeBrightness(), restore(), unplugging the display, resetting it (a brownout) and writing to it
+      before update() notices, and time passing with update() calls.
+      Each sequence is run twice, on a display that was just powered on:
+
+        1. in reference mode (setReferenceMode(true)), where every command and character is sent in
+           its own i2c transmission, the way the library first did it.
+        2. with the optimized transfers (bulk writes, batched commands, skipped cells).
+
+      In each run, no command or read may come while the display is busy, i2cTransactions() has to
+      count the transmissions that the display got, and verifyDisplay() has to pass. The two runs have
+      to leave the display the same (DDRAM, CGRAM, address counter, entry mode, display control,
+      display shift, backlight and brightness), and the optimized run must not use more i2c
+      transmissions than the reference run.
+
+      The animations are made by I2cCharAnimationCompiler from random frames. They are played in the
+      sequences, and on their own: after each frame, the display has to show the frame and its custom
+      characters, in both modes.
+
+      When a seed fails, calls are removed from the sequence one at a time as long as it still fails,
+      and the seed and the smallest failing sequence are printed.
+
+      Build it (and ../I2cCharAnimationCompiler) with any C++11 compiler, from this folder, with the
+      features that are turned off by default turned on, e.g.
+          g++ -O2 -I. -I../../src -DDISPLAY_MARQUEES=2 -DDISPLAY_LAYERS=4 -DDISPLAY_QUEUE_SIZE=8
+              -DDISPLAY_FIELDS=4 -DDISPLAY_MAPPEDCHARACTERS=8 -o I2cCharDisplayFuzz I2cCharDisplayFuzz.cpp
+              DisplayEmulator.cpp ArduinoShim.cpp ../../src/I2cCharDisplay.cpp
+
+      Usage:
+          I2cCharDisplayFuzz [-s seed] [-n count] [-d display] [-c compiler]
+
+          -s seed       the first seed (default 1)
+          -n count      number of seeds to test on each display (default 1000)
+          -d display    only test one display: lcd1, lcd2, lcd4, mcp2, mcp4, oled2 or oled4
+          -c compiler   the I2cCharAnimationCompiler program (default ../I2cCharAnimationCompiler/I2cCharAnimationCompiler)
+
+      The exit code is 1 if a seed or an animation failed.
+
+  License Information:  https://www.dcity.org/license-information/
+*/
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "I2cCharDisplay.h"
+#include "DisplayEmulator.h"
+
+#if DISPLAY_MARQUEES < 2 || DISPLAY_LAYERS == 0 || DISPLAY_QUEUE_SIZE == 0 || DISPLAY_FIELDS == 0 || DISPLAY_MAPPEDCHARACTERS == 0
+#error "build with the marquees, layers, isr queue, fields and mapCharacter() turned on (see the build command above)"
+#endif
+
+
+#define MAX_OPS            32       // longest sequence of library calls
+#define OP_TYPES           35       // number of kinds of library calls (see runOp())
+#define FUZZ_LAYERS        (DISPLAY_LAYERS + 1)  // layers made for each run (one more than the display can take)
+#define ANIMATIONS         12       // animations made for each display
+#define MAX_FRAMES         6
+#define ANIMATION_SOURCE   "I2cCharDisplayFuzz-animation.txt"   // files for the compiler (removed when done)
+#define ANIMATION_BINARY   "I2cCharDisplayFuzz-animation.bin"
+
+
+// a display to test, and how long its controller is busy (the setTiming() preset has to cover it)
+struct DisplayConfig
+{
+  const char *name;
+  uint8_t type;
+  uint8_t address;
+  uint8_t rows;
+  uint8_t cols;
+  uint8_t timing;                  // setTiming() preset
+  uint16_t commandTime;            // us that the controller is busy after a command
+  uint16_t dataTime;               // after a character
+  uint16_t clearTime;              // after clear
+};
+
+static const DisplayConfig configs[] = {
+  { "lcd1",  LCD_TYPE,          0x27, 1, 16, TIMING_HD44780, 37, 41, 1520 },
+  { "lcd2",  LCD_TYPE,          0x27, 2, 16, TIMING_HD44780, 37, 41, 1520 },
+  { "lcd4",  LCD_TYPE,          0x27, 4, 20, TIMING_HD44780, 37, 41, 1520 },
+  { "mcp2",  LCD_MCP23017_TYPE, 0x20, 2, 16, TIMING_HD44780, 37, 41, 1520 },
+  { "mcp4",  LCD_MCP23017_TYPE, 0x20, 4, 20, TIMING_HD44780, 37, 41, 1520 },
+  { "oled2", OLED_TYPE,         0x3C, 2, 16, TIMING_US2066,  20, 20, 1800 },
+  { "oled4", OLED_TYPE,         0x3C, 4, 20, TIMING_US2066,  20, 20, 1800 },
+};
+
+// an animation, and the frames it was made from (to check what the display shows)
+struct AnimationFrame
+{
+  uint16_t time;
+  std::vector<uint8_t> cells;      // rows * cols characters
+  uint8_t glyphs[8][8];            // the custom characters, after the glyphs sent with this frame
+  uint8_t glyphsDefined;           // one bit for each custom character that has been sent
+};
+
+struct Animation
+{
+  uint8_t rows;
+  uint8_t cols;
+  std::vector<AnimationFrame> frames;
+  std::vector<uint8_t> data;       // made by I2cCharAnimationCompiler
+};
+
+// what a run did
+struct RunResult
+{
+  DisplayState state;              // the display after the last call
+  uint32_t transactions;           // i2c transmissions of the whole run (begin() and the calls)
+  std::string problem;             // the first problem found (empty if none)
+};
+
+// the objects that a sequence of calls uses
+struct Fuzz
+{
+  const DisplayConfig *config;
+  I2cCharDisplay *display;
+  I2cCharLayer *layers[FUZZ_LAYERS];
+  std::vector<Animation> *animations;
+};
+
+static const char *marqueeTexts[] = {
+  "Hello marquee world",
+  "x",
+  "A longer line of text that scrolls past the end of every window",
+  "",
+  "25\xC2\xB0" "C \xE2\x9C\x93 \xC3",                 // UTF-8 (25°C ✓), when a charset is set
+};
+
+static const char *utf8Texts[] = {
+  "25\xC2\xB0" "C",                                     // 25°C
+  "10\xC2\xB5s",                                        // 10µs
+  "\xC3\x84\xC3\x96\xC3\x9C \xC3\xA4\xC3\xB6\xC3\xBC\xC3\x9F",  // ÄÖÜ äöüß
+  "\xC2\xA5" "100 \xE2\x86\x92",                        // ¥100 →
+  "\xE2\x9C\x93 done",                                  // ✓ done
+  "\xC3\xB1 \xC2\xBD\xE2\x82\xAC",                      // ñ ½€
+  "bad \xC3 \x80 utf8",                                 // broken sequences
+};
+
+static const uint32_t mappedCodepoints[] = { 0x2713, 0x2192, 0x00B0, 0x20AC, 0x00C4 };
+
+static const uint8_t characterMapsP[3][8] PROGMEM = {
+  { 0x04, 0x0E, 0x1F, 0x04, 0x04, 0x04, 0x04, 0x00 },
+  { 0x00, 0x0A, 0x1F, 0x1F, 0x0E, 0x04, 0x00, 0x00 },
+  { 0x1F, 0x11, 0x11, 0x11, 0x11, 0x11, 0x1F, 0x00 },
+};
+
+static uint32_t randomState;       // state of the xorshift random numbers
+static const char *compilerName = "../I2cCharAnimationCompiler/I2cCharAnimationCompiler";
+
+
+// xorshift random numbers (the same seed always gives the same sequence)
+static uint32_t nextRandom()
+{
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+
+static void seedRandom(uint32_t seed)
+{
+  randomState = seed * 2654435761UL | 1;     // spread the seeds out (the state can't be 0)
+}
+
+
+// DDRAM address of row,col (positions start at 1), like I2cCharDisplay::ddramAddress()
+static uint8_t cellAddress(const DisplayConfig &config, uint8_t row, uint8_t col)
+{
+  static const uint8_t offsets2Rows[] = { 0x00, 0x40 };
+  static const uint8_t offsets4RowsLcd[] = { 0x00, 0x40, 0x14, 0x54 };
+  static const uint8_t offsets4RowsOled[] = { 0x00, 0x20, 0x40, 0x60 };
+
+  if (config.rows <= 2)
+    return offsets2Rows[row - 1] + col - 1;
+  if (config.type == OLED_TYPE)
+    return offsets4RowsOled[row - 1] + col - 1;
+  return offsets4RowsLcd[row - 1] + col - 1;
+}
+
+
+static std::string describeByte(uint8_t value)
+{
+  char text[16];
+  if (value >= 0x20 && value < 0x7F)
+    snprintf(text, sizeof(text), "'%c' (0x%02X)", value, value);
+  else
+    snprintf(text, sizeof(text), "0x%02X", value);
+  return text;
+}
+
+
+// ********************************************** animations ********************************************
+
+
+static char randomCell(uint8_t glyphsDefined)
+{
+  uint32_t r = nextRandom() % 100;
+  static const char plain[] = " abcdefXYZ0123456789#*-=.";
+
+  if (r < 10 && glyphsDefined != 0)
+  {
+    uint8_t glyph;
+    do
+    {
+      glyph = nextRandom() % 8;
+    } while (!(glyphsDefined & (1 << glyph)));
+    return glyph;
+  }
+  if (r < 14)
+    return (r & 1) ? '|' : '\\';
+  if (r < 19)
+    return (char)(0xA0 + nextRandom() % 0x60);
+  return plain[nextRandom() % (sizeof(plain) - 1)];
+}
+
+
+// the frames of a random animation, and its input file for the compiler
+static std::string makeAnimation(Animation &animation, uint8_t rows, uint8_t cols)
+{
+  std::string source;
+  char line[128];
+  AnimationFrame frame;
+
+  animation.rows = rows;
+  animation.cols = cols;
+  memset(frame.glyphs, 0, sizeof(frame.glyphs));
+  frame.glyphsDefined = 0;
+  frame.cells.assign(rows * cols, ' ');
+
+  snprintf(line, sizeof(line), "# made by I2cCharDisplayFuzz\nsize %d %d\n", rows, cols);
+  source += line;
+
+  uint8_t frameCount = 1 + nextRandom() % MAX_FRAMES;
+  for (uint8_t f = 0; f < frameCount; ++f)
+  {
+    uint8_t newGlyphs = (f == 0 || nextRandom() % 3 == 0) ? nextRandom() % 4 : 0;
+    for (uint8_t g = 0; g < newGlyphs; ++g)
+    {
+      uint8_t glyph = nextRandom() % 8;
+      source += "glyph " + std::to_string(glyph);
+      for (uint8_t i = 0; i < 8; ++i)
+      {
+        uint8_t pixels = nextRandom() & 0x1F;
+        frame.glyphs[glyph][i] = pixels;
+        if (i & 1)                  // both ways of writing a glyph row
+        {
+          snprintf(line, sizeof(line), " 0x%02x", pixels);
+        }
+        else
+        {
+          snprintf(line, sizeof(line), " %d%d%d%d%d", (pixels >> 4) & 1, (pixels >> 3) & 1, (pixels >> 2) & 1,
+                   (pixels >> 1) & 1, pixels & 1);
+        }
+        source += line;
+      }
+      source += "\n";
+      frame.glyphsDefined |= 1 << glyph;
+    }
+
+    uint16_t changes = (f == 0) ? rows * cols : nextRandom() % (rows * cols + 1);
+    for (uint16_t i = 0; i < changes; ++i)
+    {
+      frame.cells[(f == 0) ? i : nextRandom() % (rows * cols)] = randomCell(frame.glyphsDefined);
+    }
+    frame.time = 20 + nextRandom() % 400;
+    animation.frames.push_back(frame);
+
+    source += "frame " + std::to_string(frame.time) + "\n";
+    for (uint8_t r = 0; r < rows; ++r)
+    {
+      source += "|";
+      for (uint8_t c = 0; c < cols; ++c)
+      {
+        uint8_t character = frame.cells[r * cols + c];
+        if (character < 8)
+          snprintf(line, sizeof(line), "\\%d", character);
+        else if (character == '\\' || character == '|')
+          snprintf(line, sizeof(line), "\\%c", character);
+        else if (character >= 0x80)
+          snprintf(line, sizeof(line), "\\x%02X", character);
+        else
+          snprintf(line, sizeof(line), "%c", character);
+        source += line;
+      }
+      source += "|\n";
+    }
+  }
+  return source;
+}
+
+
+// make an animation with I2cCharAnimationCompiler, returns false if the compiler failed
+static bool compileAnimation(const std::string &source, std::vector<uint8_t> &data)
+{
+  FILE *file = fopen(ANIMATION_SOURCE, "w");
+  if (file == NULL)
+  {
+    perror(ANIMATION_SOURCE);
+    return false;
+  }
+  fputs(source.c_str(), file);
+  fclose(file);
+
+  std::string command = std::string("\"") + compilerName + "\" -b -o " ANIMATION_BINARY " " ANIMATION_SOURCE;
+  int status = system(command.c_str());
+  if (status != 0)
+  {
+    fprintf(stderr, "%s failed (%d) on:\n%s", compilerName, status, source.c_str());
+    return false;
+  }
+
+  file = fopen(ANIMATION_BINARY, "rb");
+  if (file == NULL)
+  {
+    perror(ANIMATION_BINARY);
+    return false;
+  }
+  data.clear();
+  int c;
+  while ((c = fgetc(file)) != EOF)
+  {
+    data.push_back(c);
+  }
+  fclose(file);
+  remove(ANIMATION_SOURCE);
+  remove(ANIMATION_BINARY);
+  return true;
+}
+
+
+static bool makeAnimations(const DisplayConfig &config, std::vector<Animation> &animations)
+{
+  seedRandom(config.rows * 100 + config.cols);
+  animations.resize(ANIMATIONS);
+  for (uint8_t i = 0; i < ANIMATIONS; ++i)
+  {
+    uint8_t rows = 1 + nextRandom() % config.rows;
+    uint8_t cols = 1 + nextRandom() % config.cols;
+    std::string source = makeAnimation(animations[i], rows, cols);
+    if (!compileAnimation(source, animations[i].data))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+// ********************************************** runs ********************************************
+
+
+// a display that was just powered on and initialized, with blank custom characters (the CGRAM isn't
+// cleared by begin(), and a character that is only partly written would keep rows the library never sent)
+static void startRun(const DisplayConfig &config, I2cCharDisplay &display)
+{
+  uint8_t blank[8][8];
+
+  hostMicros = 0;
+  hostMillis = 0;
+  emulator.setBusyTimes(config.commandTime, config.dataTime, config.clearTime);
+  emulator.powerOn(config.type, config.address, config.rows, 0xFF);
+  display.setTiming(config.timing);
+  display.begin();
+  memset(blank, 0, sizeof(blank));
+  display.createCharacters(blank, 0, 8);
+}
+
+
+// make one library call, the kind is op % OP_TYPES and its values come from the other bits of op
+static void runOp(Fuzz &fuzz, uint32_t op)
+{
+  const DisplayConfig &config = *fuzz.config;
+  I2cCharDisplay &display = *fuzz.display;
+  I2cCharLayer &layer = *fuzz.layers[(op >> 8) % FUZZ_LAYERS];
+  uint8_t a = op >> 8;
+  uint8_t b = op >> 16;
+  uint8_t c = op >> 24;
+  char text[48];
+  uint8_t length;
+
+  switch (op % OP_TYPES)
+  {
+  case 0:
+    display.cursorMove(1 + a % config.rows, 1 + b % (config.cols + 4));
+    break;
+
+  case 1:                           // a short string
+    length = 1 + a % 8;
+    for (uint8_t i = 0; i < length; ++i)
+    {
+      text[i] = 'A' + (b + i * 7) % 58;
+    }
+    text[length] = 0;
+    display.print(text);
+    break;
+
+  case 2:
+    display.clear();
+    break;
+
+  case 3:
+    display.home();
+    break;
+
+  case 4:
+  {
+    uint8_t map[8];
+    for (uint8_t i = 0; i < 8; ++i)
+    {
+      map[i] = (a * (i + 3) + b) & 0x1F;
+    }
+    display.createCharacter(a % 8, map);
+    break;
+  }
+
+  case 5:
+  {
+    uint8_t maps[3][8];
+    for (uint8_t m = 0; m < 3; ++m)
+    {
+      for (uint8_t i = 0; i < 8; ++i)
+      {
+        maps[m][i] = (b + m * 11 + i * 5) & 0x1F;
+      }
+    }
+    if (c & 1)
+      display.createCharacters_P(characterMapsP, a % 6, 1 + b % 3);
+    else
+      display.createCharacters(maps, a % 6, 1 + b % 3);
+    break;
+  }
+
+  case 6:                           // a custom character
+    display.write((uint8_t)(a % 8));
+    break;
+
+  case 7:
+    if (a & 1)
+      display.displayShiftLeft();
+    else
+      display.displayShiftRight();
+    break;
+
+  case 8:
+    if (a & 1)
+      display.cursorShiftLeft();
+    else
+      display.cursorShiftRight();
+    break;
+
+  case 9:
+    if (a % 4 == 0)
+      display.displayRightToLeft();
+    else
+      display.displayLeftToRight();
+    break;
+
+  case 10:
+    if (a % 4 == 0)
+      display.displayShiftOn();
+    else
+      display.displayShiftOff();
+    break;
+
+  case 11:
+    switch (a % 6)
+    {
+    case 0:  display.cursorOn();       break;
+    case 1:  display.cursorOff();      break;
+    case 2:  display.cursorBlinkOn();  break;
+    case 3:  display.cursorBlinkOff(); break;
+    case 4:  display.displayOff();     break;
+    default: display.displayOn();      break;
+    }
+    break;
+
+  case 12:
+    if (config.type == OLED_TYPE)
+      display.setBrightness(a);
+    else if (a & 1)
+      display.backlightOn();
+    else
+      display.backlightOff();
+    break;
+
+  case 13:                          // a cell through the isr queue (sent by update())
+    display.isrSetCell(1 + a % config.rows, 1 + b % config.cols, 'a' + b % 26);
+    display.update();
+    break;
+
+  case 14:                          // a long string (past the end of a line)
+    length = 16 + a % 24;
+    for (uint8_t i = 0; i < length; ++i)
+    {
+      text[i] = '0' + (b + i) % 40;
+    }
+    text[length] = 0;
+    display.print(text);
+    break;
+
+  case 15:                          // text with custom characters in it
+    length = 1 + a % 12;
+    for (uint8_t i = 0; i < length; ++i)
+    {
+      text[i] = ((b + i) % 3 == 0) ? (c + i) % 8 : 'a' + (c + i) % 26;
+    }
+    display.write((const uint8_t *)text, length);
+    break;
+
+  case 16:
+    display.marqueeStart(a % (config.rows + 2), b % (config.cols + 2), 1 + c % (config.cols + 2),   // sometimes off the display
+                         marqueeTexts[(a >> 4) % (sizeof(marqueeTexts) / sizeof(marqueeTexts[0]))], 50 + b * 2);
+    break;
+
+  case 17:
+    display.marqueeStop(a % (DISPLAY_MARQUEES + 1));
+    break;
+
+  case 18:                          // time passes (marquees, animations, fades, fields and probes step)
+    hostMillis += 1 + (a | (b << 8)) % 800;
+    display.update();
+    break;
+
+  case 19:
+    if (b & 1)
+      display.addLayer(layer);
+    else
+      display.removeLayer(layer);
+    break;
+
+  case 20:
+    layer.setPosition(1 + b % (config.rows + 1), 1 + c % (config.cols + 2));
+    break;
+
+  case 21:
+    switch (b % 3)
+    {
+    case 0:  layer.setZ(c % 4); break;
+    case 1:  layer.show();      break;
+    default: layer.hide();      break;
+    }
+    break;
+
+  case 22:
+    switch (b % 4)
+    {
+    case 0:
+      layer.clear();
+      break;
+
+    case 1:
+      layer.cursorMove(1 + c % 3, 1 + (c >> 2) % 10);
+      break;
+
+    case 2:
+      layer.setCell(1 + c % 3, 1 + (c >> 2) % 10, 'A' + c % 26);
+      break;
+
+    default:
+      snprintf(text, sizeof(text), (c & 1) ? "L%d\nz%d" : "layer %d %d", a, c);
+      layer.print(text);
+      break;
+    }
+    break;
+
+  case 23:
+    display.compose();
+    break;
+
+  case 24:
+    display.animationStart((*fuzz.animations)[a % fuzz.animations->size()].data.data(), b & 1);
+    break;
+
+  case 25:
+    display.animationStop();
+    break;
+
+  case 26:
+    display.defineField(a % (DISPLAY_FIELDS + 1), b % (config.rows + 2), c % (config.cols + 2), 1 + (a >> 3) % 12);   // sometimes off the display
+    break;
+
+  case 27:
+    display.isrSetField(a % (DISPLAY_FIELDS + 1), (int32_t)((b << 8 | c) * ((a & 0x80) ? -40503L : 1013L)));
+    if (c & 1)
+      display.isrRequestFlush();
+    break;
+
+  case 28:
+    display.setFieldInterval((a & 1) ? 0 : b * 4);
+    break;
+
+  case 29:
+    display.setCharset(a % 4);
+    display.print(utf8Texts[b % (sizeof(utf8Texts) / sizeof(utf8Texts[0]))]);
+    break;
+
+  case 30:
+    display.mapCharacter(mappedCodepoints[a % (sizeof(mappedCodepoints) / sizeof(mappedCodepoints[0]))], (b & 1) ? b % 8 : '#');
+    break;
+
+  case 31:
+    display.fadeBrightness(b, (c % 8) * 60, a % 4);
+    break;
+
+  case 32:
+    display.restore();
+    break;
+
+  case 33:                          // the display is reset (a brownout), and is written to before update() notices
+  {
+    uint32_t lost = emulator.lost();
+    uint32_t errors = emulator.errors();
+    emulator.powerOn(config.type, config.address, config.rows, a);
+    display.cursorMove(1 + b % config.rows, 1 + c % config.cols);
+    display.print("brownout");
+    emulator.excuse(emulator.lost() - lost, emulator.errors() - errors);   // the library can't know about the reset yet
+    hostMillis += DISPLAY_PROBE_INTERVAL + 1;
+    display.update();
+    break;
+  }
+
+  default:                          // the display is unplugged, and comes back after a power cycle
+    emulator.unplug();
+    display.print("unplugged");
+    emulator.powerOn(config.type, config.address, config.rows, a);
+    hostMillis += DISPLAY_PROBE_INTERVAL + 1;
+    display.update();
+    break;
+  }
+}
+
+
+static const char *opName(uint32_t op)
+{
+  static const char *names[OP_TYPES] = {
+    "cursorMove", "print short", "clear", "home", "createCharacter", "createCharacters", "write custom",
+    "displayShift", "cursorShift", "entry direction", "entry shift", "display control", "brightness/backlight",
+    "isrSetCell", "print long", "write with custom", "marqueeStart", "marqueeStop", "time passes",
+    "addLayer/removeLayer", "layer setPosition", "layer setZ/show/hide", "layer text", "compose",
+    "animationStart", "animationStop", "defineField", "isrSetField", "setFieldInterval", "setCharset and print",
+    "mapCharacter", "fadeBrightness", "restore", "brownout and print", "unplug and power cycle"
+  };
+  return names[op % OP_TYPES];
+}
+
+
+// check what the library and the display did in a run, returns the first problem (empty if none)
+static std::string checkRun(I2cCharDisplay &display, uint32_t lost, uint32_t errors, uint32_t transactions)
+{
+  char text[128];
+
+  if (emulator.lost() != lost)
+  {
+    snprintf(text, sizeof(text), "%u commands, characters or reads came while the display was busy",
+             (unsigned)(emulator.lost() - lost));
+    return text;
+  }
+  if (emulator.errors() != errors)
+  {
+    return "the display got a transmission it can't understand";
+  }
+  if (display.i2cTransactions() != emulator.transactions() - transactions)
+  {
+    snprintf(text, sizeof(text), "i2cTransactions() is %u, the display got %u", (unsigned)display.i2cTransactions(),
+             (unsigned)(emulator.transactions() - transactions));
+    return text;
+  }
+
+  DisplayState before = emulator.state();
+  if (!display.verifyDisplay())
+  {
+    return "verifyDisplay() failed";
+  }
+  const DisplayState &after = emulator.state();
+  if (after.addressCounter != before.addressCounter || after.addressIsCgram != before.addressIsCgram ||
+      after.entryMode != before.entryMode)
+  {
+    return "verifyDisplay() didn't put the cursor and entry mode back";
+  }
+  if (emulator.lost() != lost)
+  {
+    return "verifyDisplay() read the display while it was busy";
+  }
+  return "";
+}
+
+
+// run a sequence on a display that was just powered on
+static void runOps(const DisplayConfig &config, std::vector<Animation> &animations, const std::vector<uint32_t> &ops,
+                   bool reference, RunResult &result)
+{
+  uint32_t lost = emulator.lost();
+  uint32_t errors = emulator.errors();
+  uint32_t transactions = emulator.transactions();
+  I2cCharDisplay display(config.type, config.address, config.rows);
+  uint8_t buffers[FUZZ_LAYERS][3 * DISPLAY_MAX_COLUMNS];
+  I2cCharLayer statusBar(buffers[0], 1, config.cols);
+  I2cCharLayer popup(buffers[1], 2, 8);
+  I2cCharLayer column(buffers[2], 3, 5);
+  I2cCharLayer cell(buffers[3], 1, 1);
+  I2cCharLayer wide(buffers[4], 2, 30);
+  Fuzz fuzz = { &config, &display, { &statusBar, &popup, &column, &cell, &wide }, &animations };
+
+  startRun(config, display);
+  display.setReferenceMode(reference);
+  for (size_t i = 0; i < ops.size(); ++i)
+  {
+    runOp(fuzz, ops[i]);
+  }
+
+  result.state        = emulator.state();
+  result.transactions = emulator.transactions() - transactions;
+  result.problem      = checkRun(display, lost, errors, transactions);
+}
+
+
+// returns the first difference between the displays of two runs (empty if none)
+static std::string compareStates(const DisplayState &reference, const DisplayState &optimized)
+{
+  char text[128];
+
+  for (uint8_t i = 0; i < EMULATOR_DDRAM_SIZE; ++i)
+  {
+    if (reference.ddram[i] != optimized.ddram[i])
+    {
+      snprintf(text, sizeof(text), "DDRAM 0x%02X is %s, reference %s", i, describeByte(optimized.ddram[i]).c_str(),
+               describeByte(reference.ddram[i]).c_str());
+      return text;
+    }
+  }
+  for (uint8_t i = 0; i < EMULATOR_CGRAM_SIZE; ++i)
+  {
+    if (reference.cgram[i] != optimized.cgram[i])
+    {
+      snprintf(text, sizeof(text), "CGRAM 0x%02X is 0x%02X, reference 0x%02X", i, optimized.cgram[i], reference.cgram[i]);
+      return text;
+    }
+  }
+  if (reference.addressCounter != optimized.addressCounter || reference.addressIsCgram != optimized.addressIsCgram)
+  {
+    snprintf(text, sizeof(text), "the address counter is %s 0x%02X, reference %s 0x%02X",
+             optimized.addressIsCgram ? "CGRAM" : "DDRAM", optimized.addressCounter,
+             reference.addressIsCgram ? "CGRAM" : "DDRAM", reference.addressCounter);
+    return text;
+  }
+  if (reference.entryMode != optimized.entryMode)
+  {
+    snprintf(text, sizeof(text), "the entry mode is 0x%02X, reference 0x%02X", optimized.entryMode, reference.entryMode);
+    return text;
+  }
+  if (reference.displayControl != optimized.displayControl)
+  {
+    snprintf(text, sizeof(text), "the display control is 0x%02X, reference 0x%02X", optimized.displayControl,
+             reference.displayControl);
+    return text;
+  }
+  if (reference.displayShift != optimized.displayShift)
+  {
+    snprintf(text, sizeof(text), "the display shift is %d, reference %d", optimized.displayShift, reference.displayShift);
+    return text;
+  }
+  if (reference.backlight != optimized.backlight || reference.brightness != optimized.brightness ||
+      reference.fade != optimized.fade)
+  {
+    return "the backlight, brightness or fade is different";
+  }
+  return "";
+}
+
+
+// run a sequence in reference mode and optimized, returns the first problem (empty if none)
+static std::string runBoth(const DisplayConfig &config, std::vector<Animation> &animations,
+                           const std::vector<uint32_t> &ops, uint32_t *referenceTransactions = NULL,
+                           uint32_t *optimizedTransactions = NULL)
+{
+  RunResult reference;
+  RunResult optimized;
+  char text[128];
+
+  runOps(config, animations, ops, true, reference);
+  runOps(config, animations, ops, false, optimized);
+  if (referenceTransactions != NULL)
+  {
+    *referenceTransactions = reference.transactions;
+    *optimizedTransactions = optimized.transactions;
+  }
+
+  if (!reference.problem.empty())
+  {
+    return "reference run: " + reference.problem;
+  }
+  if (!optimized.problem.empty())
+  {
+    return "optimized run: " + optimized.problem;
+  }
+  std::string difference = compareStates(reference.state, optimized.state);
+  if (!difference.empty())
+  {
+    return "optimized run: " + difference;
+  }
+  if (optimized.transactions > reference.transactions)
+  {
+    snprintf(text, sizeof(text), "optimized run: %u i2c transmissions, reference %u", (unsigned)optimized.transactions,
+             (unsigned)reference.transactions);
+    return text;
+  }
+  return "";
+}
+
+
+// make the sequence for a seed and test it, returns false (and prints the smallest failing sequence) if it fails
+static bool runSeed(const DisplayConfig &config, std::vector<Animation> &animations, uint32_t seed,
+                    uint32_t &referenceTransactions, uint32_t &optimizedTransactions)
+{
+  std::vector<uint32_t> ops;
+
+  seedRandom(seed);
+  ops.resize(1 + nextRandom() % MAX_OPS);
+  for (size_t i = 0; i < ops.size(); ++i)
+  {
+    ops[i] = nextRandom();
+  }
+
+  std::string problem = runBoth(config, animations, ops, &referenceTransactions, &optimizedTransactions);
+  if (problem.empty())
+  {
+    return true;
+  }
+
+  // remove calls one at a time, as long as the sequence still fails
+  size_t i = 0;
+  while (i < ops.size() && ops.size() > 1)
+  {
+    std::vector<uint32_t> shorter = ops;
+    shorter.erase(shorter.begin() + i);
+    std::string shorterProblem = runBoth(config, animations, shorter);
+    if (!shorterProblem.empty())
+    {
+      ops.swap(shorter);            // still fails without it
+      problem = shorterProblem;
+    }
+    else
+    {
+      i++;                          // it is needed
+    }
+  }
+
+  printf("FAIL %s seed %u, %d calls:\n", config.name, (unsigned)seed, (int)ops.size());
+  for (i = 0; i < ops.size(); ++i)
+  {
+    printf("  %-22s a=%-3d b=%-3d c=%d\n", opName(ops[i]), (uint8_t)(ops[i] >> 8), (uint8_t)(ops[i] >> 16),
+           (uint8_t)(ops[i] >> 24));
+  }
+  printf("  %s\n", problem.c_str());
+  return false;
+}
+
+
+// compare the display to a frame of an animation, returns the first difference (empty if none)
+static std::string compareFrame(const DisplayConfig &config, const Animation &animation, const AnimationFrame &frame)
+{
+  const DisplayState &state = emulator.state();
+  char text[128];
+
+  for (uint8_t row = 1; row <= animation.rows; ++row)
+  {
+    for (uint8_t col = 1; col <= animation.cols; ++col)
+    {
+      uint8_t expected = frame.cells[(row - 1) * animation.cols + col - 1];
+      uint8_t shown = state.ddram[cellAddress(config, row, col)];
+      if (shown != expected)
+      {
+        snprintf(text, sizeof(text), "row %d col %d is %s, the frame has %s", row, col, describeByte(shown).c_str(),
+                 describeByte(expected).c_str());
+        return text;
+      }
+    }
+  }
+  for (uint8_t glyph = 0; glyph < 8; ++glyph)
+  {
+    if ((frame.glyphsDefined & (1 << glyph)) && memcmp(&state.cgram[glyph * 8], frame.glyphs[glyph], 8) != 0)
+    {
+      snprintf(text, sizeof(text), "custom character %d is not the glyph of the frame", glyph);
+      return text;
+    }
+  }
+  return "";
+}
+
+
+// play an animation (twice with repeat, then once without), and check each frame that the display shows
+static std::string playAnimation(const DisplayConfig &config, const Animation &animation, bool reference)
+{
+  I2cCharDisplay display(config.type, config.address, config.rows);
+  uint32_t lost = emulator.lost();
+  uint32_t errors = emulator.errors();
+  uint32_t transactions = emulator.transactions();
+  char text[64];
+
+  startRun(config, display);
+  display.setReferenceMode(reference);
+  for (uint8_t pass = 0; pass < 3; ++pass)
+  {
+    bool repeat = (pass < 2);
+    if (pass != 1 && !display.animationStart(animation.data.data(), repeat))
+    {
+      return "animationStart() didn't take the animation";
+    }
+    for (size_t f = 0; f < animation.frames.size(); ++f)
+    {
+      const AnimationFrame &frame = animation.frames[f];
+      std::string difference = compareFrame(config, animation, frame);
+      if (difference.empty())
+      {
+        hostMillis += frame.time - 1;   // the frame is still shown just before its time is up
+        display.update();
+        difference = compareFrame(config, animation, frame);
+      }
+      if (!difference.empty())
+      {
+        snprintf(text, sizeof(text), "pass %d frame %d: ", pass + 1, (int)f + 1);
+        return text + difference;
+      }
+      hostMillis += 1;
+      display.update();
+      if (repeat && f + 1 == animation.frames.size())
+      {
+        display.update();           // the update() at the end of a repeating animation starts it again, the next one shows the first frame
+      }
+    }
+    if (display.animationRunning() != repeat)
+    {
+      return repeat ? "a repeating animation stopped" : "the animation didn't stop at its end";
+    }
+  }
+  display.animationStop();
+  if (display.animationRunning())
+  {
+    return "animationStop() didn't stop the animation";
+  }
+  return checkRun(display, lost, errors, transactions);
+}
+
+
+static bool checkAnimations(const DisplayConfig &config, const std::vector<Animation> &animations)
+{
+  bool ok = true;
+
+  for (size_t i = 0; i < animations.size(); ++i)
+  {
+    for (uint8_t mode = 0; mode < 2; ++mode)
+    {
+      std::string problem = playAnimation(config, animations[i], mode == 0);
+      if (!problem.empty())
+      {
+        printf("FAIL %s animation %d (%dx%d, %d frames), %s mode: %s\n", config.name, (int)i + 1, animations[i].rows,
+               animations[i].cols, (int)animations[i].frames.size(), (mode == 0) ? "reference" : "optimized",
+               problem.c_str());
+        ok = false;
+      }
+    }
+  }
+
+  // an animation made for a larger display is not played (its cells would go past the rows of the DDRAM)
+  I2cCharDisplay display(config.type, config.address, config.rows);
+  startRun(config, display);
+  for (uint8_t size = 0; size < 4; ++size)
+  {
+    std::vector<uint8_t> data = animations[0].data;
+    data[3 + (size & 1)] = (size < 2) ? 0 : (size == 2) ? config.rows + 1 : 81;
+    if (display.animationStart(data.data(), false) || display.animationRunning())
+    {
+      printf("FAIL %s animationStart() took an animation with %d rows and %d cols\n", config.name, data[3], data[4]);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+
+// ********************************************** feature checks ********************************************
+
+
+// compare the cells starting at row,col to text, returns the first difference (empty if none)
+static std::string compareCells(const DisplayConfig &config, uint8_t row, uint8_t col, const std::string &text)
+{
+  const DisplayState &state = emulator.state();
+  char line[128];
+
+  for (size_t i = 0; i < text.size(); ++i)
+  {
+    uint8_t shown = state.ddram[cellAddress(config, row, col + i)];
+    if (shown != (uint8_t)text[i])
+    {
+      snprintf(line, sizeof(line), "row %d col %d is %s, expected %s", row, (int)(col + i), describeByte(shown).c_str(),
+               describeByte(text[i]).c_str());
+      return line;
+    }
+  }
+  return "";
+}
+
+
+// the window of a marquee after position steps (the text and a window of blanks, then it starts over)
+static std::string marqueeWindow(const std::string &text, uint8_t width, uint16_t position)
+{
+  std::string window;
+  uint16_t length = text.size();
+
+  for (uint8_t i = 0; i < width; ++i)
+  {
+    uint16_t index = (position + i) % (length + width);
+    window += (index < length) ? text[index] : ' ';
+  }
+  return window;
+}
+
+
+// a marquee steps once every stepTime ms, and stays where it is when it is stopped. shown is what the
+// text looks like on the display (with a charset, the UTF-8 text is translated)
+static std::string runMarquee(const DisplayConfig &config, I2cCharDisplay &display, const char *text,
+                              const std::string &shown)
+{
+  uint8_t width = 7;
+  uint16_t steps = shown.size() + width + 3;   // past the point where it starts over
+  std::string problem;
+
+  uint8_t marquee = display.marqueeStart(config.rows, 3, width, text, 100);
+  for (uint16_t step = 0; step < steps && problem.empty(); ++step)
+  {
+    problem = compareCells(config, config.rows, 3, marqueeWindow(shown, width, step));
+    hostMillis += 99;               // not time for the next step yet
+    display.update();
+    if (problem.empty())
+    {
+      problem = compareCells(config, config.rows, 3, marqueeWindow(shown, width, step));
+    }
+    hostMillis += 1;
+    display.update();
+  }
+  display.marqueeStop(marquee);
+  hostMillis += 1000;
+  display.update();
+  if (problem.empty())
+  {
+    problem = compareCells(config, config.rows, 3, marqueeWindow(shown, width, steps));
+  }
+  return problem;
+}
+
+
+static std::string checkMarquee(const DisplayConfig &config, I2cCharDisplay &display)
+{
+  std::string problem = runMarquee(config, display, marqueeTexts[0], marqueeTexts[0]);
+
+  if (problem.empty())              // a UTF-8 marquee steps one display character at a time
+  {
+    display.setCharset(CHARSET_HD44780_A00);
+    problem = runMarquee(config, display, "25\xC2\xB0" "C \xC2\xB5s \xC3 x",
+                         std::string("25\xDF" "C \xE4s  ", 9) + "x");      // 25°C µs, and a broken sequence (dropped)
+    display.setCharset(CHARSET_RAW);
+  }
+  return problem.empty() ? "" : "marquee: " + problem;
+}
+
+
+// a field shows its value right aligned, or *s if it doesn't fit
+static std::string fieldText(int32_t value, uint8_t width)
+{
+  char text[16];
+
+  snprintf(text, sizeof(text), "%*ld", width, (long)value);
+  if (strlen(text) > width)
+  {
+    return std::string(width, '*');
+  }
+  return text;
+}
+
+
+static std::string checkFields(const DisplayConfig &config, I2cCharDisplay &display)
+{
+  static const int32_t values[] = { 0, 42, -7, 9999, -999, 123456, -12345, 5 };
+  std::string problem;
+
+  display.defineField(0, 1, 2, 5);
+  display.defineField(1, config.rows, config.cols - 3, 4);
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]) && problem.empty(); ++i)
+  {
+    display.isrSetField(0, values[i]);
+    display.isrSetField(1, -values[i]);
+    display.update();
+    problem = compareCells(config, 1, 2, fieldText(values[i], 5));
+    if (problem.empty())
+    {
+      problem = compareCells(config, config.rows, config.cols - 3, fieldText(-values[i], 4));
+    }
+  }
+  display.defineField(0, 1, 1, 0);  // stop drawing them
+  display.defineField(1, 1, 1, 0);
+
+  // a field that is not on the display is not defined
+  if (problem.empty() && (display.defineField(0, 0, 1, 3) || display.defineField(0, config.rows + 1, 1, 3) ||
+                          display.defineField(0, 1, 0, 3) || display.defineField(DISPLAY_FIELDS, 1, 1, 3)))
+  {
+    problem = "defineField() took a field that is not on the display";
+  }
+  if (problem.empty() && display.marqueeStart(0, 1, 4, "text", 100) != MARQUEE_NONE)
+  {
+    problem = "marqueeStart() took row 0";
+  }
+  return problem.empty() ? "" : "fields: " + problem;
+}
+
+
+// what the harness expects a layer to be (the layer objects keep it to themselves)
+struct LayerModel
+{
+  I2cCharLayer *layer;
+  const uint8_t *buffer;
+  uint8_t rows;
+  uint8_t cols;
+  uint8_t row;
+  uint8_t col;
+  uint8_t z;
+  bool visible;
+  bool added;
+};
+
+
+// the cell of the top visible layer (the one added last if the z is the same), blank if no layer covers it
+static uint8_t expectedLayerCell(const LayerModel *models, uint8_t count, uint8_t row, uint8_t col)
+{
+  const LayerModel *top = NULL;
+
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    const LayerModel &m = models[i];
+    if (m.added && m.visible && row >= m.row && row < m.row + m.rows && col >= m.col && col < m.col + m.cols &&
+        (top == NULL || m.z >= top->z))
+    {
+      top = &m;
+    }
+  }
+  return (top == NULL) ? ' ' : top->buffer[(row - top->row) * top->cols + col - top->col];
+}
+
+
+// compose() shows the top layer of every cell, after layers are added, raised, hidden, removed and moved
+static std::string checkLayers(const DisplayConfig &config, I2cCharDisplay &display)
+{
+  uint8_t bufferA[2 * 6];
+  uint8_t bufferB[1 * 4];
+  I2cCharLayer a(bufferA, 2, 6);
+  I2cCharLayer b(bufferB, 1, 4);
+  LayerModel models[2] = {
+    { &a, bufferA, 2, 6, 1, 3, 0, true, false },
+    { &b, bufferB, 1, 4, 1, 5, 0, true, false },
+  };
+  char text[64];
+
+  display.clear();                  // compose() only draws the cells that the layers cover (or covered)
+  a.setPosition(1, 3);
+  a.print("abcdef\nghijkl");
+  b.setPosition(1, 5);
+  b.print("WXYZ");
+
+  for (uint8_t step = 0; step < 7; ++step)
+  {
+    switch (step)
+    {
+    case 0:  display.addLayer(a);    models[0].added = true;                         break;
+    case 1:  display.addLayer(b);    models[1].added = true;                         break;   // same z, b was added last
+    case 2:  a.setZ(2);              models[0].z = 2;                                break;
+    case 3:  a.hide();               models[0].visible = false;                      break;
+    case 4:  display.removeLayer(b); models[1].added = false;                        break;
+    case 5:
+      a.setPosition(config.rows, 2);
+      a.show();
+      models[0].row     = config.rows;
+      models[0].col     = 2;
+      models[0].visible = true;
+      break;
+    default: a.setCell(1, 1, '*');                                                   break;
+    }
+    display.compose();
+
+    for (uint8_t row = 1; row <= config.rows; ++row)
+    {
+      for (uint8_t col = 1; col <= config.cols; ++col)
+      {
+        uint8_t expected = expectedLayerCell(models, 2, row, col);
+        uint8_t shown = emulator.state().ddram[cellAddress(config, row, col)];
+        if (shown != expected)
+        {
+          snprintf(text, sizeof(text), "layers step %d: row %d col %d is %s, expected %s", step + 1, row, col,
+                   describeByte(shown).c_str(), describeByte(expected).c_str());
+          display.removeLayer(a);
+          return text;
+        }
+      }
+    }
+  }
+  display.removeLayer(a);           // the layers are going away
+  display.compose();
+  return "";
+}
+
+
+// UTF-8 text is printed with the characters of the display ROM, and mapCharacter() adds characters
+static std::string checkCharset(const DisplayConfig &config, I2cCharDisplay &display)
+{
+  std::string problem;
+
+  display.clear();
+  display.setCharset(CHARSET_HD44780_A00);
+  display.mapCharacter(0x2713, 0);
+  display.print("25\xC2\xB0" "C \xC2\xB5\xE2\x9C\x93");     // 25°C µ✓
+  problem = compareCells(config, 1, 1, std::string("25\xDF" "C \xE4", 6) + std::string(1, '\0'));
+  if (problem.empty())
+  {
+    display.setCharset(CHARSET_HD44780_A02);
+    display.cursorMove(1, 1);
+    display.print("\xC2\xB0\xC2\xB5");                     // °µ
+    problem = compareCells(config, 1, 1, "\xB0\xB5");
+  }
+  if (problem.empty())
+  {
+    display.setCharset(CHARSET_US2066_ASCII);
+    display.cursorMove(1, 1);
+    display.print("A\xE2\x9C\x93\xC2\xB0");                // A✓° (° isn't mapped)
+    problem = compareCells(config, 1, 1, std::string("A", 1) + std::string(1, '\0') + "?");
+  }
+  display.setCharset(CHARSET_RAW);
+  return problem.empty() ? "" : "charset: " + problem;
+}
+
+
+// fadeBrightness() steps the brightness from update() until it gets there (oleds only)
+static std::string checkFade(const DisplayConfig &config, I2cCharDisplay &display)
+{
+  if (config.type != OLED_TYPE)
+  {
+    return "";
+  }
+  for (uint8_t curve = FADE_LINEAR; curve <= FADE_EASEINOUT; ++curve)
+  {
+    uint8_t target = (curve & 1) ? 0x10 : 0xE0;
+    uint8_t start = emulator.state().brightness;
+    uint8_t last = start;
+
+    display.fadeBrightness(target, 300, curve);
+    for (uint16_t time = 0; time < 400; time += 7)
+    {
+      hostMillis += 7;
+      display.update();
+      uint8_t now = emulator.state().brightness;
+      if ((target < start) ? (now > last) : (now < last))
+      {
+        return "fade: the brightness went the wrong way";
+      }
+      last = now;
+    }
+    if (display.fadeBrightnessRunning() || emulator.state().brightness != target)
+    {
+      return "fade: the brightness didn't get to the end of the fade";
+    }
+  }
+  return "";
+}
+
+
+// check what marquees, fields, layers, charsets and fades show, in both modes
+static bool checkFeatures(const DisplayConfig &config)
+{
+  bool ok = true;
+
+  for (uint8_t mode = 0; mode < 2; ++mode)
+  {
+    I2cCharDisplay display(config.type, config.address, config.rows);
+    uint32_t lost = emulator.lost();
+    uint32_t errors = emulator.errors();
+    uint32_t transactions = emulator.transactions();
+
+    startRun(config, display);
+    display.setReferenceMode(mode == 0);
+    std::string problem = checkMarquee(config, display);
+    if (problem.empty())
+      problem = checkFields(config, display);
+    if (problem.empty())
+      problem = checkLayers(config, display);
+    if (problem.empty())
+      problem = checkCharset(config, display);
+    if (problem.empty())
+      problem = checkFade(config, display);
+    if (problem.empty())
+      problem = checkRun(display, lost, errors, transactions);
+    if (!problem.empty())
+    {
+      printf("FAIL %s %s mode: %s\n", config.name, (mode == 0) ? "reference" : "optimized", problem.c_str());
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+
+// a warm start (begin(BEGIN_WARM) after the microcontroller was reset) keeps what the rows show, and the
+// snapshot it reads back is right: verifyDisplay() passes, and blanks printed over the old text are sent
+static bool checkWarmStart(const DisplayConfig &config)
+{
+  bool ok = true;
+
+  for (uint8_t mode = 0; mode < 2; ++mode)
+  {
+    I2cCharDisplay display(config.type, config.address, config.rows);
+    std::string shown[4];
+    std::string problem;
+
+    uint8_t length = (config.rows > 2 && config.type != OLED_TYPE) ? config.cols : config.cols + 6;
+
+    startRun(config, display);
+    display.setReferenceMode(mode == 0);
+    for (uint8_t row = 1; row <= config.rows; ++row)   // past the columns that are shown (a 4 row lcd shows all of its DDRAM)
+    {
+      for (uint8_t col = 0; col < length; ++col)
+      {
+        shown[row - 1] += (char)('A' + (row * 7 + col) % 26);
+      }
+      display.cursorMove(row, 1);
+      display.print(shown[row - 1].c_str());
+      shown[row - 1].resize(config.cols);
+    }
+
+    I2cCharDisplay warm(config.type, config.address, config.rows);    // the microcontroller was reset
+    uint32_t lost = emulator.lost();
+    uint32_t errors = emulator.errors();
+    uint32_t transactions = emulator.transactions();
+    warm.setTiming(config.timing);
+    warm.setReferenceMode(mode == 0);
+    if (!warm.begin(BEGIN_WARM))
+    {
+      problem = "begin(BEGIN_WARM) didn't use the warm start";
+    }
+    for (uint8_t row = 1; row <= config.rows && problem.empty(); ++row)
+    {
+      problem = compareCells(config, row, 1, shown[row - 1]);
+    }
+    if (problem.empty())
+    {
+      problem = checkRun(warm, lost, errors, transactions);
+    }
+    if (problem.empty())
+    {
+      warm.cursorMove(config.rows, 2);
+      warm.print("   ");
+      problem = compareCells(config, config.rows, 1, shown[config.rows - 1].substr(0, 1) + "   " + shown[config.rows - 1].substr(4));
+    }
+    if (!problem.empty())
+    {
+      printf("FAIL %s %s mode: warm start: %s\n", config.name, (mode == 0) ? "reference" : "optimized", problem.c_str());
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+
+// an lcd backpack that doesn't connect the read/write pin: nothing is read back, and update() doesn't
+// take it for a display that was reset
+static bool checkUnreadable(const DisplayConfig &config)
+{
+  I2cCharDisplay display(config.type, config.address, config.rows);
+  uint8_t ddram[DISPLAY_DDRAM_SIZE];
+  uint8_t cgram[DISPLAY_CGRAM_SIZE];
+  std::string problem;
+
+  if (config.type != LCD_TYPE)
+  {
+    return true;
+  }
+  hostMicros = 0;
+  hostMillis = 0;
+  emulator.setBusyTimes(config.commandTime, config.dataTime, config.clearTime);
+  emulator.powerOn(config.type, config.address, config.rows, 0xFF);
+  emulator.setReadWritePin(false);
+  display.setTiming(config.timing);
+  display.begin();
+  display.print("no read");
+
+  uint32_t lost = emulator.lost();
+  uint32_t errors = emulator.errors();
+  uint32_t transactions = display.i2cTransactions();
+  for (uint8_t i = 0; i < 4; ++i)
+  {
+    hostMillis += DISPLAY_PROBE_INTERVAL + 1;
+    display.update();
+  }
+  if (display.i2cTransactions() - transactions > 8)
+  {
+    problem = "update() restored a display that can't be read";
+  }
+  if (problem.empty() && display.readDisplayMemory(ddram, cgram))
+  {
+    problem = "readDisplayMemory() read a display that can't be read";
+  }
+  if (problem.empty())
+  {
+    problem = compareCells(config, 1, 1, "no read");
+  }
+
+  I2cCharDisplay warm(config.type, config.address, config.rows);      // the microcontroller was reset
+  warm.setTiming(config.timing);
+  if (problem.empty() && !warm.begin(BEGIN_WARM))
+  {
+    problem = "begin(BEGIN_WARM) didn't use the warm start";
+  }
+  if (problem.empty())              // the contents can't be read back, so it is cleared
+  {
+    warm.print("ok");
+    problem = compareCells(config, 1, 1, "ok     ");
+  }
+  if (problem.empty() && (emulator.lost() != lost || emulator.errors() != errors))
+  {
+    problem = "a command or character came while the display was busy";
+  }
+  if (!problem.empty())
+  {
+    printf("FAIL %s without the read/write pin: %s\n", config.name, problem.c_str());
+    return false;
+  }
+  return true;
+}
+
+
+// update() only waits for its i2c transmissions: the marquee steps, the queued cells and fields, the layer
+// cells and the probe don't wait the oled commandDelay (10ms with TIMING_US2066_SAFE).
+static bool checkUpdateWaits(const DisplayConfig &config)
+{
+  I2cCharDisplay display(config.type, config.address, config.rows);
+  uint8_t buffer[4];
+  I2cCharLayer layer(buffer, 1, 4);
+  unsigned long longest = 0;
+
+  if (config.type != OLED_TYPE)     // the lcd timings don't wait after a command
+  {
+    return true;
+  }
+  hostMicros = 0;
+  hostMillis = 0;
+  emulator.setBusyTimes(config.commandTime, config.dataTime, config.clearTime);
+  emulator.powerOn(config.type, config.address, config.rows, 0xFF);
+  display.setTiming(TIMING_US2066_SAFE);
+  display.begin();
+  display.marqueeStart(1, 1, 8, "a marquee that steps at every update", 100);
+  display.defineField(0, config.rows, 10, 5);
+  layer.setPosition(config.rows, 1);
+  display.addLayer(layer);
+
+  uint32_t lost = emulator.lost();
+  for (uint8_t i = 0; i < 20; ++i)
+  {
+    hostMillis += DISPLAY_PROBE_INTERVAL + 1;     // the marquee step and the probe are due
+    display.isrSetCell(1, 12, 'a' + i);
+    display.isrSetField(0, i * 37);
+    layer.cursorMove(1, 1);
+    layer.print(i * 11);
+    unsigned long start = hostMicros;
+    display.update();
+    if (hostMicros - start > longest)
+    {
+      longest = hostMicros - start;
+    }
+  }
+  if (longest >= 10000 || emulator.lost() != lost)
+  {
+    printf("FAIL %s update() took %lu us (with TIMING_US2066_SAFE), %u commands lost\n",
+           config.name, longest, (unsigned)(emulator.lost() - lost));
+    return false;
+  }
+  return true;
+}
+
+
+// A sketch that never calls update() (like the examples) has no hot plug checks, so a write that a glitch
+// on the bus loses must not stop the writes that follow it.
+static bool checkGlitch(const DisplayConfig &config)
+{
+  I2cCharDisplay display(config.type, config.address, config.rows);
+  std::string problem;
+
+  hostMicros = 0;
+  hostMillis = 0;
+  emulator.setBusyTimes(config.commandTime, config.dataTime, config.clearTime);
+  emulator.powerOn(config.type, config.address, config.rows, 0xFF);
+  display.setTiming(config.timing);
+  display.begin();
+  display.print("ab");
+  emulator.glitch();
+  display.print("cd");              // lost
+  display.clear();
+  display.print("after");
+  problem = compareCells(config, 1, 1, "after");
+  if (!problem.empty())
+  {
+    printf("FAIL %s after a glitch without update(): %s\n", config.name, problem.c_str());
+    return false;
+  }
+  return true;
+}
+
+
+static void usage()
+{
+  fprintf(stderr, "usage: I2cCharDisplayFuzz [-s seed] [-n count] [-d display] [-c compiler]\n");
+  exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+  uint32_t firstSeed = 1;
+  uint32_t count = 1000;
+  const char *only = NULL;
+  bool ok = true;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+      firstSeed = strtoul(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      count = strtoul(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+      only = argv[++i];
+    else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+      compilerName = argv[++i];
+    else
+      usage();
+  }
+
+  bool found = false;
+  for (size_t d = 0; d < sizeof(configs) / sizeof(configs[0]); ++d)
+  {
+    const DisplayConfig &config = configs[d];
+    std::vector<Animation> animations;
+    uint32_t failures = 0;
+    uint64_t referenceSum = 0;
+    uint64_t optimizedSum = 0;
+
+    if (only != NULL && strcmp(only, config.name) != 0)
+    {
+      continue;
+    }
+    found = true;
+    if (!makeAnimations(config, animations))
+    {
+      return 1;
+    }
+    ok = checkAnimations(config, animations) && ok;
+    ok = checkFeatures(config) && ok;
+    ok = checkWarmStart(config) && ok;
+    ok = checkUnreadable(config) && ok;
+    ok = checkGlitch(config) && ok;
+    ok = checkUpdateWaits(config) && ok;
+
+    for (uint32_t seed = firstSeed; seed < firstSeed + count; ++seed)
+    {
+      uint32_t referenceTransactions;
+      uint32_t optimizedTransactions;
+      if (!runSeed(config, animations, seed, referenceTransactions, optimizedTransactions))
+      {
+        failures++;
+      }
+      referenceSum += referenceTransactions;
+      optimizedSum += optimizedTransactions;
+    }
+    printf("%s: %u seeds, %u failures, i2c transmissions: reference %llu, optimized %llu\n", config.name,
+           (unsigned)count, (unsigned)failures, (unsigned long long)referenceSum, (unsigned long long)optimizedSum);
+    ok = ok && failures == 0;
+  }
+  if (!found)
+  {
+    usage();
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,41 @@
+/*
+  Wire.h
+
+  Short Description:
+
+      The Wire (i2c) class of the Arduino core, for building I2cCharDisplay on a computer with
+      I2cCharDisplayFuzz. The transmissions go to the display emulator (see DisplayEmulator.h).
+
+  License Information:  https://www.dcity.org/license-information/
+*/
+
+#ifndef WIRE_H_HOST
+#define WIRE_H_HOST
+
+#include "Arduino.h"
+
+#define WIRE_BUFFER_SIZE  32     // like the Arduino Wire library, a transmission can't be longer
+
+class TwoWire {
+public:
+  void begin();
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t data);
+  uint8_t endTransmission(bool sendStop = true);      // 0 if the transmission was acknowledged, 2 if the address wasn't
+  uint8_t requestFrom(uint8_t address, uint8_t count);
+  int available();
+  int read();
+
+private:
+  uint8_t _address;
+  uint8_t _txBuffer[WIRE_BUFFER_SIZE];
+  uint8_t _txCount;
+  bool _txOverflow;              // more bytes were written than fit in a transmission
+  uint8_t _rxBuffer[WIRE_BUFFER_SIZE];
+  uint8_t _rxCount;
+  uint8_t _rxIndex;
+};
+
+extern TwoWire Wire;
+
+#endif
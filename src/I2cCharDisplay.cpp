@@ -27,6 +27,41 @@
           void fadeOff();           // turns off the fade feature of the OLED
           void fadeOnce(uint8_t);   // fade out the display to off (fade time 0-16) - (on some display types, it doesn't work very well. It takes the display to half brightness and then turns off display)
           void fadeBlink(uint8_t);  // blinks the fade feature of the OLED (fade time 0-16) - (on some display types, it doesn't work very well. It takes the display to half brightness and then turns off display)
+    1.1.0 - 10/18/2026
+        Added begin(BEGIN_WARM), which probes the display and skips the full (slow) initialization
+          if the display is still configured, e.g. after a watchdog reset of the microcontroller.
+          What the rows show is read back (the first DISPLAY_WARM_COLUMNS of each row).
+        Added a snapshot of the display state, and update() which detects a display that was unplugged
+          or reset (brownout) and restores its settings, custom characters and contents. The oled and
+          an lcd that can be read keep a signature in DDRAM, which a reset erases (see displayConfigured()).
+        Added marqueeStart()/marqueeStop(), which scroll a long text through a window in one row
+          (stepped by update(), and only the characters that change are sent).
+        Added fadeBrightness(), a smooth oled brightness fade with easing curves (stepped by update()).
+        setBrightness() and the fade functions now send their commands in one i2c transmission
+          (instead of 10 commands with a 10ms delay after each), and they no longer move the cursor.
+        Added createCharacters() and createCharacters_P() (from flash), which create several custom
+          characters in one transfer and put the cursor back.
+        Added setCharset() and mapCharacter(), which print UTF-8 text (e.g. °, µ, arrows) with the
+          character codes of the lcd display ROM (HD44780 A00/A02). On an oled, CHARSET_US2066_ASCII
+          decodes UTF-8 and prints ASCII, and mapCharacter() adds the other characters. Marquees
+          that start while a charset is set are translated too.
+        print() now sends a whole string in as few i2c transmissions as possible.
+        Added the I2cCharLayer class and addLayer()/removeLayer()/compose(), for windows (status bars,
+          popups, etc.) that are composed onto the display. Only the cells that change are sent.
+        Added animationStart()/animationStop(), which play an animation (e.g. a boot splash) from flash.
+          Animations are made from text files by extras/I2cCharAnimationCompiler (run on a computer).
+        Added isrSetCell(), isrSetField() and isrRequestFlush(), which can be called from an interrupt
+          handler. They only queue the change (no i2c), and update() sends it to the display.
+        Marquees, layers, the isr queue, fields and mapCharacter() are turned off by default, so that they
+          don't take RAM. Set their sizes in I2cCharDisplay.h to use them.
+        Added setTiming() with presets for several display modules, and calibrateTiming(), which finds
+          the shortest reliable timing of a module. All of the waits in the library now come from the timing.
+        Added LCD_MCP23017_TYPE, for lcds on MCP23017 backpacks. The lcd is used in 8 bit mode, and a character
+          and its enable pulse are sent in 4 bytes of one i2c transmission.
+        Added setReferenceMode(), i2cTransactions(), readDisplayMemory() and verifyDisplay(), which the
+          I2cCharDisplayFuzz example uses to check the optimized i2c transfers against simple ones.
+        clear() now sets the entry mode back to left to right (the display does this), and doesn't shift
+          the display when it puts the signature back.
 
 
   Short Description:
@@ -41,8 +76,8 @@
 
       The library will work with **LCD** and **OLED** character displays
       (e.g. 16x2, 20x2, 20x4, etc.). The LCD displays must use the the
-      HD44780 controller chip and have a I2C PCA8574 i/o expander chip
-      on a backpack board (which gives the display I2C capability).
+      HD44780 controller chip and have a I2C PCA8574 (or MCP23017) i/o
+      expander chip on a backpack board (which gives the display I2C capability).
       OLED display modules must have the US2066 controller chip
       (which has I2C built in). Backback boards are available and
       details are in the link below.
@@ -78,48 +113,198 @@
 #define Wire1 Wire             // regular arduinos don't have a second i2c port, just redefine Wire1 to be Wire
 #endif
 
+// The isr queue needs a record to be written (or read) completely before the head (or tail) moves.
+// 8 bit arduinos have one core, so it is enough to stop the compiler from moving the memory accesses.
+#ifdef ARDUINO_ARCH_AVR
+#define QUEUE_BARRIER()  __asm__ __volatile__("" ::: "memory")
+#else
+#define QUEUE_BARRIER()  __sync_synchronize()
+#endif
+
+
+// setTiming() presets, one row for each TIMING_ preset:
+//   powerUpDelay (ms), setupDelay (ms), resetDelay, resyncDelay, commandDelay, clearDelay, enablePulse (us)
+// An lcd command takes 37us (57us on the clones), which is less than the i2c transfer of the next command,
+// so the lcds don't need a commandDelay.
+static const uint16_t timingPresets[][7] PROGMEM = {
+  {  50,    0, 4100, 100,     0, 1530, 1 },  // TIMING_HD44780
+  {  75,    0, 6200, 150,     0, 2300, 1 },  // TIMING_HD44780_CLONE
+  { 100, 1000, 4300, 150,     0, 2000, 1 },  // TIMING_HD44780_SAFE
+  { 100,    0,    0,   0,  1000, 2000, 0 },  // TIMING_US2066
+  { 100,  100,    0,   0, 10000, 2000, 0 },  // TIMING_US2066_SAFE
+};
+
+
+// charset tables used by setCharset()
+//
+// Each charset has:
+//   - a bitmap of the ASCII codes (one bit each) that the display ROM doesn't show as ASCII. All of the
+//     other ASCII codes are sent as they are, so plain text is never looked up in a table.
+//   - a table of unicode codepoints that the display ROM has, sorted by codepoint (for a binary search).
+//     Each entry covers count codepoints in a row, that map to count character codes in a row.
+//   - the character code to use for codepoints that the ROM doesn't have.
+// Codepoints that are not in a table (or added with mapCharacter()) are shown as the replacement character.
+
+struct CharsetRange
+{
+  uint16_t codepoint;              // first unicode codepoint of the range
+  uint8_t character;               // display character code of the first codepoint
+  uint8_t count;                   // number of codepoints in the range
+};
+
+static const uint8_t asciiNoChanges[16] PROGMEM = { 0 };
+
+static const uint8_t asciiHd44780A00[16] PROGMEM = {   // the Japanese ROM has a yen sign for \ and an arrow for ~
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x40
+};
+
+static const CharsetRange charsetHd44780A00[] PROGMEM = {
+  { 0x00A2, 0xEC,  1 },    // ¢
+  { 0x00A5, 0x5C,  1 },    // ¥
+  { 0x00B0, 0xDF,  1 },    // ° (the ROM has a small circle that is used as a degree sign)
+  { 0x00B5, 0xE4,  1 },    // µ
+  { 0x00B7, 0xA5,  1 },    // ·
+  { 0x00DF, 0xE2,  1 },    // ß
+  { 0x00E4, 0xE1,  1 },    // ä
+  { 0x00F1, 0xEE,  1 },    // ñ
+  { 0x00F6, 0xEF,  1 },    // ö
+  { 0x00F7, 0xFD,  1 },    // ÷
+  { 0x00FC, 0xF5,  1 },    // ü
+  { 0x03A3, 0xF6,  1 },    // Σ
+  { 0x03A9, 0xF4,  1 },    // Ω
+  { 0x03B1, 0xE0,  1 },    // α
+  { 0x03B2, 0xE2,  1 },    // β
+  { 0x03B5, 0xE3,  1 },    // ε
+  { 0x03B8, 0xF2,  1 },    // θ
+  { 0x03BC, 0xE4,  1 },    // μ
+  { 0x03C0, 0xF7,  1 },    // π
+  { 0x03C1, 0xE6,  1 },    // ρ
+  { 0x03C3, 0xE5,  1 },    // σ
+  { 0x2126, 0xF4,  1 },    // Ω (ohm sign)
+  { 0x2190, 0x7F,  1 },    // ←
+  { 0x2192, 0x7E,  1 },    // →
+  { 0x221A, 0xE8,  1 },    // √
+  { 0x221E, 0xF3,  1 },    // ∞
+  { 0x2588, 0xFF,  1 },    // █
+  { 0x3001, 0xA4,  1 },    // 、
+  { 0x3002, 0xA1,  1 },    // 。
+  { 0x300C, 0xA2,  2 },    // 「 」
+  { 0x30FB, 0xA5,  1 },    // ・
+  { 0x4E07, 0xFB,  1 },    // 万
+  { 0x5343, 0xFA,  1 },    // 千
+  { 0x5186, 0xFC,  1 },    // 円
+  { 0xFF61, 0xA1, 63 }     // half width katakana
+};
+
+static const CharsetRange charsetHd44780A02[] PROGMEM = {
+  { 0x00A1, 0xA1,  7 },    // ¡ ¢ £ ¤ ¥ ¦ §
+  { 0x00A9, 0xA9,  3 },    // © ª «
+  { 0x00AE, 0xAE,  1 },    // ®
+  { 0x00B0, 0xB0,  4 },    // ° ± ² ³
+  { 0x00B5, 0xB5,  3 },    // µ ¶ ·
+  { 0x00B9, 0xB9,  7 },    // ¹ º » ¼ ½ ¾ ¿
+  { 0x00C0, 0xC0, 64 }     // À - ÿ
+};
+
+static const CharsetRange charsetAsciiOnly[] PROGMEM = {
+  { 0x0000, 0x00,  0 }
+};
+
+struct Charset
+{
+  const uint8_t *ascii;            // bitmap of the ASCII codes that need the table
+  const CharsetRange *table;       // codepoint ranges (in flash)
+  uint8_t tableSize;               // number of ranges in the table
+  uint8_t replacement;             // character code to show for codepoints that are not in the table
+};
+
+// in the same order as the CHARSET_ values
+static const Charset charsets[] PROGMEM = {
+  { asciiNoChanges,  charsetAsciiOnly,  0,                                                 '?' },    // CHARSET_RAW (not used)
+  { asciiHd44780A00, charsetHd44780A00, sizeof(charsetHd44780A00) / sizeof(CharsetRange), '?' },    // CHARSET_HD44780_A00
+  { asciiNoChanges,  charsetHd44780A02, sizeof(charsetHd44780A02) / sizeof(CharsetRange), '?' },    // CHARSET_HD44780_A02
+  { asciiNoChanges,  charsetAsciiOnly,  0,                                                 '?' }     // CHARSET_US2066_ASCII
+};
+
 
 // class constructors
 
 // use this constructor if using the main i2c port (pins SDA and SCL)
 I2cCharDisplay::I2cCharDisplay(uint8_t displayType, uint8_t i2cAddress, uint8_t rows)
 {
-  _displayType         = displayType;
-  _i2cAddress          = i2cAddress;
-  _i2cPort             = 0;
-  _rows                = rows;
-  _lcdBacklightControl = LCD_BACKLIGHTON;
+  init(displayType, i2cAddress, rows, 0);
 }
 
 // use this constructor if you want to specify which i2c port to use (0 or 1) (port 0 uses pins SDA and SCL, and port 1 uses pins SDA1 and SCL1, for example on an Arduino Due board)
 I2cCharDisplay::I2cCharDisplay(uint8_t displayType, uint8_t i2cAddress, uint8_t rows, uint8_t i2cPort)
 {
-  _displayType         = displayType;
-  _i2cAddress          = i2cAddress;
-  _i2cPort             = i2cPort;
-  _rows                = rows;
-  _lcdBacklightControl = LCD_BACKLIGHTON;
+  init(displayType, i2cAddress, rows, i2cPort);
 }
 
-
 // public functions
 
 
 void I2cCharDisplay::begin()
 {
+  begin(BEGIN_COLD);
+}
+
+
+// beginMode = BEGIN_COLD will always run the full initialization of the display.
+// beginMode = BEGIN_WARM will first probe the display, and if it is still configured (e.g. the
+//   microcontroller was reset by a watchdog, but the display kept its power) the slow power up
+//   initialization is skipped. The display control, entry mode and cursor are restored and what the
+//   rows of the display show is left as it is (it is read back into the snapshot, see readSnapshot()).
+// returns true if the warm start was used
+bool I2cCharDisplay::begin(uint8_t beginMode)
+{
+  bool warm = false;
+
   if (_i2cPort==0)
     Wire.begin();   // init i2c
   if (_i2cPort==1)
     Wire1.begin();   // init the other i2c port
 
+  _displayAttached = true;
+  _lastProbeTime   = millis();
+
   switch (_displayType)
   {
   case LCD_TYPE:
-    lcdBegin();
+    warm = (beginMode == BEGIN_WARM && lcdConfigured());
+    if (warm)
+    {
+      lcdWarmBegin();
+    }
+    else
+    {
+      lcdBegin();
+    }
     break;
 
   case OLED_TYPE:
-    oledBegin();
+    warm = (beginMode == BEGIN_WARM && oledConfigured());
+    if (warm)
+    {
+      oledWarmBegin();
+    }
+    else
+    {
+      oledBegin();
+    }
+    break;
+
+  case LCD_MCP23017_TYPE:
+    warm = (beginMode == BEGIN_WARM && mcpConfigured());
+    if (warm)
+    {
+      mcpWarmBegin();
+    }
+    else
+    {
+      mcpBegin();
+    }
     break;
 
   default:
@@ -127,593 +312,3308 @@ void I2cCharDisplay::begin()
     break;
   }
 
-}
-
+  // the oled is read over i2c, and the MCP23017 backpack connects the read/write pin of the lcd
+  _displayReadable = (_displayType != LCD_TYPE) || lcdReadable();
 
+  if (warm)
+  {
+    readSnapshot();
+    return true;
+  }
 
-// functions to interface with higher level Arduino and Particle functions (like Print)
+  // clear display and home cursor
+  clear();
+  home();
 
-// this allows the print command to be used to write to the display...
-// e.g. if your display class is myLcd, then you can use  myLcd.print("hello world");  to write to the lcd
-inline size_t I2cCharDisplay::write(uint8_t value)
-{
-  sendData(value);
-  return 1;         // we have printed one character
+  return false;
 }
 
 
-// functions that work with both OLED and LCD
-
-void I2cCharDisplay::clear()
+// Call this often from loop(). It only does the work that is due:
+//   - first checks that the display is still there (see checkDisplay()), so nothing is sent to a display
+//     that was reset before it is restored
+//   - steps the marquees whose step time has passed
+//   - steps the brightness fade (see fadeBrightness())
+//   - sends the cells and fields queued by the isr...() functions (see isrSetCell())
+//   - sends the cells that the layers changed (see compose())
+//   - sends the next animation frame when its time has come (see animationStart())
+// Apart from the i2c transmissions it doesn't wait, except when a display that was unplugged or reset
+// is restored: restore() runs the full initialization of the display, with its power up delays
+// (more than 1 second for an lcd with the TIMING_HD44780_SAFE timing).
+void I2cCharDisplay::update()
 {
-  sendCommand(LCD_CLEARDISPLAYCOMMAND); // clear display
-  delayMicroseconds(2000);              // 1.53ms required
-}
+  _hotPlug = (_probeInterval != 0);   // the writes that fail can wait for the display to be restored
+  checkDisplay();
 
+#if DISPLAY_MARQUEES > 0
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < DISPLAY_MARQUEES; ++i)
+  {
+    Marquee &marquee = _marquees[i];
+    if (marquee.text != NULL && (now - marquee.lastStepTime) >= marquee.stepTime)
+    {
+      marquee.lastStepTime = now;
+      if (++marquee.position >= marquee.length + marquee.width)    // the text and a window of blanks, then start over
+      {
+        marquee.position = 0;
+      }
+      drawMarquee(i);
+    }
+  }
+#endif
 
-void I2cCharDisplay::home()
-{
-  cursorMove(1, 1);    // use move command instead to avoid flicker on oled displays
-  //  sendCommand(LCD_RETURNHOMECOMMAND); // move cursor to home
-  //  delayMicroseconds(2000);            // 1.53ms required
-}
+  if (_fadeRunning)
+  {
+    stepBrightnessFade();
+  }
 
+#if DISPLAY_QUEUE_SIZE > 0
+  drainQueue();
+#endif
 
-// move cursor to new postion row,col  (both start at 1)
-void I2cCharDisplay::cursorMove(uint8_t row, uint8_t col)
-{
+  compose();
 
-  if (row > _rows)              // if user points to a row too large, change row to the bottom row
+  if (_animation != NULL)
   {
-    row = _rows;
+    stepAnimation();
   }
+}
 
-  if (_rows <= 2)               // if we have a 1 or 2 row display
+
+// Every probe interval, check that the display is still there:
+//   - if the display stopped acknowledging (it was unplugged, or a connector glitched), check
+//     if the display is back, and if it is, restore the display.
+//   - if the display is attached, make a cheap check to see if it was reset (e.g. by a brownout),
+//     and if it was, restore the display.
+void I2cCharDisplay::checkDisplay()
+{
+  if (_probeInterval == 0 || (millis() - _lastProbeTime) < _probeInterval)
   {
-    uint8_t moveRowOffset2Rows[] =  { 0x00, 0x40};
-    sendCommand(LCD_SETDDRAMADDRCOMMAND | (col-1 + moveRowOffset2Rows[row-1]));
+    return;
   }
-  else                          // if we have a 3 or 4 line display
+  _lastProbeTime = millis();
+
+  if (!_displayAttached)
   {
-    if (_displayType == LCD_TYPE)           // if using an LCD
+    if (i2cProbe())             // the display is back
     {
-      uint8_t moveRowOffset4RowsLcd[] =  { 0x00, 0x40, 0x14, 0x54 };
-      sendCommand(LCD_SETDDRAMADDRCOMMAND | (col-1 + moveRowOffset4RowsLcd[row-1]));
+      restore();
     }
-    else                                    // if using an OLED
+  }
+  else if (!displayConfigured())
+  {
+    if (_displayAttached)       // the display answered, but it has lost its configuration
     {
-      uint8_t moveRowOffset4RowsOled[] = { 0x00, 0x20, 0x40, 0x60 };
-      sendCommand(LCD_SETDDRAMADDRCOMMAND | (col-1 + moveRowOffset4RowsOled[row-1]));
+      restore();
     }
   }
 }
 
 
-// display on/off
-void I2cCharDisplay::displayOff()
+// Start a marquee: text scrolls to the left through a window of width characters that starts at row,col.
+// The text can be longer than a display line (it is kept in your memory, so don't change or free it
+// while the marquee runs). update() moves it one character every stepTime ms, and only the characters
+// that change are sent. Each marquee writes to its own window, so it works on any row (the display
+// shift commands would move all of the rows).
+// If a charset is set (setCharset()) when the marquee starts, the text is UTF-8 and is translated the way
+// print() translates it, one display character per step.
+// returns the marquee number (for marqueeStop()), or MARQUEE_NONE if they are all in use or row,col is
+// not on the display
+#if DISPLAY_MARQUEES > 0
+uint8_t I2cCharDisplay::marqueeStart(uint8_t row, uint8_t col, uint8_t width, const char *text, uint16_t stepTime)
 {
-  _lcdDisplayControlCommand &= ~LCD_DISPLAYON;
-  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+  if (row < 1 || row > _rows || col < 1 || col > lineEnd(0) + 1)   // lineEnd(0) + 1 is the width of a DDRAM row
+  {
+    return MARQUEE_NONE;
+  }
+  for (uint8_t i = 0; i < DISPLAY_MARQUEES; ++i)
+  {
+    Marquee &marquee = _marquees[i];
+    if (marquee.text == NULL)
+    {
+      uint8_t address = ddramAddress(row, col) & 0x7F;
+      if (width > DISPLAY_MARQUEE_MAX_WIDTH)
+      {
+        width = DISPLAY_MARQUEE_MAX_WIDTH;
+      }
+      if (width > lineEnd(address) - address + 1)   // the window has to stay in its row
+      {
+        width = lineEnd(address) - address + 1;
+      }
+      marquee.text         = text;
+      marquee.utf8         = (_charset != CHARSET_RAW);
+      marquee.length       = 0;
+      while (*text != 0)            // the number of display characters in the text
+      {
+        marqueeCharacter(text, marquee.utf8);
+        marquee.length++;
+      }
+      marquee.position     = 0;
+      marquee.address      = address;
+      marquee.width        = width;
+      marquee.stepTime     = stepTime;
+      marquee.lastStepTime = millis();
+      drawMarquee(i);
+      return i;
+    }
+  }
+  return MARQUEE_NONE;
 }
 
 
-void I2cCharDisplay::displayOn()
+void I2cCharDisplay::marqueeStop(uint8_t marquee)
 {
-  _lcdDisplayControlCommand |= LCD_DISPLAYON;
-  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+  if (marquee < DISPLAY_MARQUEES)
+  {
+    _marquees[marquee].text = NULL;
+  }
 }
-
-
-// cursor on/off
-void I2cCharDisplay::cursorOff()
+#else
+uint8_t I2cCharDisplay::marqueeStart(uint8_t, uint8_t, uint8_t, const char *, uint16_t)
 {
-  _lcdDisplayControlCommand &= ~LCD_CURSORON;
-  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+  return MARQUEE_NONE;              // DISPLAY_MARQUEES is 0
 }
 
 
-void I2cCharDisplay::cursorOn()
+void I2cCharDisplay::marqueeStop(uint8_t)
 {
-  _lcdDisplayControlCommand |= LCD_CURSORON;
-  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
 }
+#endif
 
 
-// cursor blink on/off
-void I2cCharDisplay::cursorBlinkOff()
+// Add a layer to the display. The layer is drawn by the next compose() (or update()).
+#if DISPLAY_LAYERS > 0
+bool I2cCharDisplay::addLayer(I2cCharLayer &layer)
 {
-  _lcdDisplayControlCommand &= ~LCD_CURSORBLINKON;
-  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+  for (uint8_t i = 0; i < DISPLAY_LAYERS; ++i)
+  {
+    if (_layers[i] == &layer)
+    {
+      return true;
+    }
+  }
+  for (uint8_t i = 0; i < DISPLAY_LAYERS; ++i)
+  {
+    if (_layers[i] == NULL)
+    {
+      _layers[i] = &layer;
+      layer._display = this;
+      layer.damageArea();
+      return true;
+    }
+  }
+  return false;
 }
 
 
-void I2cCharDisplay::cursorBlinkOn()
+void I2cCharDisplay::removeLayer(I2cCharLayer &layer)
 {
-  _lcdDisplayControlCommand |= LCD_CURSORBLINKON;
-  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+  for (uint8_t i = 0; i < DISPLAY_LAYERS; ++i)
+  {
+    if (_layers[i] == &layer)
+    {
+      layer.damageArea();
+      layer._display = NULL;
+      _layers[i] = NULL;
+    }
+  }
 }
 
 
-// display shift left/right (also shifts the cursor)
-void I2cCharDisplay::displayShiftLeft(void)
+// Send the cells that the layers changed to the display. The changed areas of the visible layers
+// (and the areas of layers that were moved, shown, hidden or removed) are composed from the layers,
+// top layer first, and only the cells that are different from what the display shows are sent.
+// Cells that no visible layer covers are blank.
+void I2cCharDisplay::compose()
 {
-  sendCommand(LCD_SHIFTCOMMAND | LCD_DISPLAYSHIFT | LCD_SHIFTLEFT);
-}
+  uint8_t cells[DISPLAY_MAX_COLUMNS];
 
+  for (uint8_t i = 0; i < DISPLAY_LAYERS; ++i)
+  {
+    I2cCharLayer *layer = _layers[i];
+    if (layer != NULL && layer->_dirtyTop <= layer->_dirtyBottom)
+    {
+      if (layer->_visible)
+      {
+        damage(layer->_row + layer->_dirtyTop, layer->_col + layer->_dirtyLeft,
+               layer->_dirtyBottom - layer->_dirtyTop + 1, layer->_dirtyRight - layer->_dirtyLeft + 1);
+      }
+      layer->_dirtyTop    = 0xFF;
+      layer->_dirtyBottom = 0;
+    }
+  }
 
-void I2cCharDisplay::displayShiftRight(void)
+  for (uint8_t row = 1; row <= _rows && row <= DISPLAY_MAX_ROWS; ++row)
+  {
+    uint8_t left  = _damageLeft[row - 1];
+    uint8_t right = _damageRight[row - 1];
+    if (left > right)
+    {
+      continue;
+    }
+    for (uint8_t col = left; col <= right; ++col)
+    {
+      cells[col - left] = layerCell(row, col);
+    }
+    sendCells(ddramAddress(row, left) & 0x7F, cells, right - left + 1);
+    _damageLeft[row - 1]  = 0xFF;
+    _damageRight[row - 1] = 0;
+  }
+  finishCells();
+}
+#else
+bool I2cCharDisplay::addLayer(I2cCharLayer &)
 {
-  sendCommand(LCD_SHIFTCOMMAND | LCD_DISPLAYSHIFT | LCD_SHIFTRIGHT);
+  return false;                     // DISPLAY_LAYERS is 0
 }
 
 
-// cursor shift left/right and change the address counter
-void I2cCharDisplay::cursorShiftLeft(void)
+void I2cCharDisplay::removeLayer(I2cCharLayer &)
 {
-  sendCommand(LCD_SHIFTCOMMAND | LCD_CURSORSHIFT | LCD_SHIFTLEFT);
 }
 
 
-void I2cCharDisplay::cursorShiftRight(void)
+void I2cCharDisplay::compose()
 {
-  sendCommand(LCD_SHIFTCOMMAND | LCD_CURSORSHIFT | LCD_SHIFTRIGHT);
 }
+#endif
 
 
-// set text to flow left to right (DEFAULT MODE)
-void I2cCharDisplay::displayLeftToRight(void)
+// Play an animation that is in flash (PROGMEM). Animations are made from text files by the
+// I2cCharAnimationCompiler program in the extras folder, which only keeps the characters that
+// change from one frame to the next. update() sends each frame when it is due, and frames
+// that match what the display already shows cost nothing.
+// repeat = true plays the animation over and over until animationStop()
+// returns false if animation doesn't start with an animation header
+bool I2cCharDisplay::animationStart(const uint8_t *animation, bool repeat)
 {
-  _lcdEntryModeCommand |= LCD_DISPLAYLEFTTORIGHT;
-  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+  if (pgm_read_byte(&animation[0]) != ANIMATION_MAGIC1 || pgm_read_byte(&animation[1]) != ANIMATION_MAGIC2 ||
+      pgm_read_byte(&animation[2]) != ANIMATION_VERSION)
+  {
+    return false;
+  }
+  uint8_t rows = pgm_read_byte(&animation[3]);
+  uint8_t cols = pgm_read_byte(&animation[4]);
+  if (rows < 1 || rows > _rows || cols < 1 || cols > lineEnd(0) + 1)   // made for a larger display (lineEnd(0) + 1 is the width of a DDRAM row)
+  {
+    return false;
+  }
+  _animation           = animation;
+  _animationNext       = animation + ANIMATION_HEADERSIZE;
+  _animationRepeat     = repeat;
+  _animationFrameTime  = 0;
+  _animationFrameStart = millis();
+  stepAnimation();                  // show the first frame now
+  return true;
 }
 
 
-// set text to flow right to left
-void I2cCharDisplay::displayRightToLeft(void)
+void I2cCharDisplay::animationStop()
 {
-  _lcdEntryModeCommand &= ~LCD_DISPLAYLEFTTORIGHT;
-  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+  _animation = NULL;
 }
 
 
-// entire display shifts when new data is written to display
-void I2cCharDisplay::displayShiftOn(void)
+bool I2cCharDisplay::animationRunning()
 {
-  _lcdEntryModeCommand |= LCD_DISPLAYSHIFTON;
-  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+  return (_animation != NULL);
 }
 
 
-// entire display does not shift when new data is written to display (NORMAL MODE)
-void I2cCharDisplay::displayShiftOff(void)
+// The isr...() functions can be called from an interrupt handler (e.g. an encoder or a pulse counter).
+// They don't use i2c or wait, they only add a record to a queue that update() sends to the display.
+// The queue has no locks, so it must only be written by one interrupt handler (or only by loop()).
+// If the queue is full (update() was not called often enough), the record is lost and counted (see queueOverflows()).
+
+#if DISPLAY_QUEUE_SIZE > 0
+// show character at row,col (positions start at 1)
+bool I2cCharDisplay::isrSetCell(uint8_t row, uint8_t col, uint8_t character)
 {
-  _lcdEntryModeCommand &= ~LCD_DISPLAYSHIFTON;
-  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+  return queueRecord(QUEUE_CELL, row, col, character);
 }
 
 
-// Fill one of the 8 CGRAM memory addresses (0-7) to create custom characters
-void I2cCharDisplay::createCharacter(uint8_t address, uint8_t characterMap[])
+// draw the fields at the next update(), without waiting for the field interval
+bool I2cCharDisplay::isrRequestFlush()
 {
-  address &= 0x7;       // limit to the first 8 addresses
-  sendCommand(LCD_SETCGRAMADDRCOMMAND | (address << 3));
-  for (uint8_t i = 0; i < 8; i++)
-  {
-    write(characterMap[i]);
-  }
+  return queueRecord(QUEUE_FLUSH, 0, 0, 0);
 }
 
 
-// functions specific to LCD displays
+uint16_t I2cCharDisplay::queueOverflows()
+{
+  uint16_t count;
 
+  do                                // an 8 bit arduino reads the count in 2 steps, so read it until the interrupt handler didn't change it
+  {
+    count = _queueOverflows;
+  } while (count != _queueOverflows);
+  return count;
+}
+#else
+bool I2cCharDisplay::isrSetCell(uint8_t, uint8_t, uint8_t)
+{
+  return false;                     // DISPLAY_QUEUE_SIZE is 0
+}
 
 
-// Turn the lcd backlight off/on
-void I2cCharDisplay::backlightOff(void)
+bool I2cCharDisplay::isrRequestFlush()
 {
-  _lcdBacklightControl = LCD_BACKLIGHTOFF;
-  i2cWrite1((int)(_lcdBacklightControl));
+  return false;
 }
 
 
-void I2cCharDisplay::backlightOn(void)
+uint16_t I2cCharDisplay::queueOverflows()
 {
-  _lcdBacklightControl = LCD_BACKLIGHTON;
-  i2cWrite1((int)(_lcdBacklightControl));
+  return 0;
 }
+#endif
 
 
-// functions specific to OLED displays
-
-void I2cCharDisplay::setBrightness(uint8_t value)
+#if DISPLAY_FIELDS > 0
+// show value in a field (see defineField())
+// If several values are queued for a field before it is drawn, only the last one is drawn.
+bool I2cCharDisplay::isrSetField(uint8_t field, int32_t value)
 {
-  sendCommand(0x80);        // set RE=1
-  sendCommand(0x2A);
+  if (field >= DISPLAY_FIELDS)
+  {
+    return false;
+  }
+  return queueRecord(QUEUE_FIELD, field, 0, value);
+}
 
-  sendCommand(0x80);        // set SD=1
-  sendCommand(0x79);
 
-  sendCommand(OLED_SETBRIGHTNESSCOMMAND);
-  sendCommand(value);
+// A field shows the numbers sent by isrSetField() right aligned in width characters starting at row,col.
+// Numbers that don't fit are shown as ****. A width of 0 stops drawing the field.
+// (call this from loop(), not from the interrupt handler)
+// returns false if there is no such field, or row,col is not on the display
+bool I2cCharDisplay::defineField(uint8_t field, uint8_t row, uint8_t col, uint8_t width)
+{
+  if (field >= DISPLAY_FIELDS || row < 1 || row > _rows || col < 1 || col > lineEnd(0) + 1)
+  {
+    return false;
+  }
+  uint8_t address = ddramAddress(row, col) & 0x7F;
+  if (width > DISPLAY_FIELD_MAX_WIDTH)
+  {
+    width = DISPLAY_FIELD_MAX_WIDTH;
+  }
+  if (width > lineEnd(address) - address + 1)   // the field has to stay in its row
+  {
+    width = lineEnd(address) - address + 1;
+  }
+  _fields[field].address = address;
+  _fields[field].width   = width;
+  return true;
+}
 
-  sendCommand(0x80);        // set SD=0
-  sendCommand(0x78);
 
-  sendCommand(0x80);        // set RE=0
-  sendCommand(0x28);
+// A value that changes quickly (e.g. an encoder) is drawn at most once every interval ms, isrRequestFlush()
+// draws it at the next update(). 0 draws the fields at every update().
+void I2cCharDisplay::setFieldInterval(uint16_t interval)
+{
+  _fieldInterval = interval;
 }
-
-// Set the oled fade out feature to OFF
-void I2cCharDisplay::fadeOff()
+#else
+bool I2cCharDisplay::isrSetField(uint8_t, int32_t)
 {
-  sendCommand(0x80);        // set RE=1
-  sendCommand(0x2A);
-
-  sendCommand(0x80);        // set SD=1
-  sendCommand(0x79);
-
-  sendCommand(OLED_SETFADECOMMAND);
-  sendCommand(OLED_FADEOFF);                     // set fade feature to OFF
+  return false;                     // DISPLAY_FIELDS is 0
+}
 
-  sendCommand(0x80);        // set SD=0
-  sendCommand(0x78);
 
-  sendCommand(0x80);        // set RE=0
-  sendCommand(0x28);
+bool I2cCharDisplay::defineField(uint8_t, uint8_t, uint8_t, uint8_t)
+{
+  return false;                     // DISPLAY_FIELDS is 0
 }
 
-// Set the oled fade out feature to ON (value is the rate of fade 0-15)
-void I2cCharDisplay::fadeOnce(uint8_t value)
+
+void I2cCharDisplay::setFieldInterval(uint16_t)
 {
-  sendCommand(0x80);        // set RE=1
-  sendCommand(0x2A);
+}
+#endif
 
-  sendCommand(0x80);        // set SD=1
-  sendCommand(0x79);
 
-  sendCommand(OLED_SETFADECOMMAND);
-  sendCommand(OLED_FADEON | (0x0f & value));      // set fade feature to ON with a delay interval of value
+// In reference mode, every command and character is sent in its own i2c transmission (the way the library
+// first did it), and sendCells() doesn't skip the cells that the display already shows. The display ends up
+// the same as with the optimized transfers, so the two can be compared (see the I2cCharDisplayFuzz example).
+void I2cCharDisplay::setReferenceMode(bool on)
+{
+  _referenceMode = on;
+}
 
-  sendCommand(0x80);        // set SD=0
-  sendCommand(0x78);
 
-  sendCommand(0x80);        // set RE=0
-  sendCommand(0x28);
+uint32_t I2cCharDisplay::i2cTransactions()
+{
+  return _i2cTransactions;
 }
 
-// Set the oled fade out feature to BLINK (value is the rate of fade 0-15)
-void I2cCharDisplay::fadeBlink(uint8_t value)
+
+// Read back all of the DDRAM (128 bytes) and CGRAM (64 bytes) that the display has. DDRAM addresses that
+// the display doesn't have (see ddramAddressUsed()) are set to a blank. Only the 5 pixel bits of CGRAM are kept.
+// The entry mode and the address counter are put back afterwards.
+// Returns false if the display can't be read (e.g. an lcd backpack that doesn't connect the read/write pin,
+// which begin() finds out).
+bool I2cCharDisplay::readDisplayMemory(uint8_t *ddram, uint8_t *cgram)
 {
-  sendCommand(0x80);        // set RE=1
-  sendCommand(0x2A);
+  uint8_t data[17];
+  uint8_t offset;                   // 1 if the oled returns a dummy byte before the data
+  uint8_t address;
+  uint8_t count;
+  bool ok = true;
 
-  sendCommand(0x80);        // set SD=1
-  sendCommand(0x79);
+  if (!_displayAttached || !_displayReadable)
+  {
+    return false;
+  }
+  finishCells();
+  if (_lcdEntryModeCommand != (LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF))    // the reads need left to right
+  {
+    sendCommand(LCD_ENTRYMODECOMMAND | LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF);
+  }
 
-  sendCommand(OLED_SETFADECOMMAND);
-  sendCommand(OLED_FADEBLINK | (0x0f & value));      // set fade feature to BLINK with a delay interval of value
+  offset  = readOffset();
+  address = 0;
+  while (ok && address < DISPLAY_DDRAM_SIZE)
+  {
+    if (!ddramAddressUsed(address))
+    {
+      ddram[address++] = ' ';
+      continue;
+    }
+    count = 1;                      // read up to 16 addresses, without passing the end of a line
+    while (count < 16 && ddramAddressUsed(address + count))
+    {
+      count++;
+    }
+    ok = readMemory(LCD_SETDDRAMADDRCOMMAND | address, data, count);
+    memcpy(&ddram[address], &data[offset], count);
+    address += count;
+  }
 
-  sendCommand(0x80);        // set SD=0
-  sendCommand(0x78);
+  for (address = 0; ok && address < DISPLAY_CGRAM_SIZE; address += 16)
+  {
+    ok = readMemory(LCD_SETCGRAMADDRCOMMAND | address, data, 16);
+    for (count = 0; count < 16; ++count)
+    {
+      cgram[address + count] = data[offset + count] & 0x1F;
+    }
+  }
 
-  sendCommand(0x80);        // set RE=0
-  sendCommand(0x28);
+  if (_lcdEntryModeCommand != (LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF))
+  {
+    sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+  }
+  if (_addressIsCgram)
+  {
+    sendCommand(LCD_SETCGRAMADDRCOMMAND | _addressCounter);
+  }
+  else
+  {
+    sendCommand(LCD_SETDDRAMADDRCOMMAND | _addressCounter);
+  }
+  return ok && _displayAttached;
 }
 
 
+// Read the display back and compare it with the snapshot of what the library has sent to it:
+// the DDRAM that the display has, and the custom characters that have been written.
+bool I2cCharDisplay::verifyDisplay()
+{
+  uint8_t ddram[DISPLAY_DDRAM_SIZE];
+  uint8_t cgram[DISPLAY_CGRAM_SIZE];
 
+  if (!readDisplayMemory(ddram, cgram))
+  {
+    return false;
+  }
+  for (uint8_t address = 0; address < DISPLAY_DDRAM_SIZE; ++address)
+  {
+    if (ddramAddressUsed(address) && ddram[address] != _ddram[address])
+    {
+      return false;
+    }
+  }
+  for (uint8_t address = 0; address < DISPLAY_CGRAM_SIZE; ++address)
+  {
+    if ((_cgramUsed & (1 << (address >> 3))) && cgram[address] != (_cgram[address] & 0x1F))
+    {
+      return false;
+    }
+  }
+  return true;
+}
 
 
-
-// private functions ********************************
-
-void I2cCharDisplay::sendCommand(uint8_t value)
+// use the timing of a display module (one of the TIMING_ presets)
+// The timing is used by begin(), so call this before begin().
+void I2cCharDisplay::setTiming(uint8_t preset)
 {
-  switch (_displayType)
+  if (preset > TIMING_US2066_SAFE)
   {
-  case LCD_TYPE:
-    sendLcdCommand(value);
-    break;
+    return;
+  }
+  _timing.powerUpDelay = pgm_read_word(&timingPresets[preset][0]);
+  _timing.setupDelay   = pgm_read_word(&timingPresets[preset][1]);
+  _timing.resetDelay   = pgm_read_word(&timingPresets[preset][2]);
+  _timing.resyncDelay  = pgm_read_word(&timingPresets[preset][3]);
+  _timing.commandDelay = pgm_read_word(&timingPresets[preset][4]);
+  _timing.clearDelay   = pgm_read_word(&timingPresets[preset][5]);
+  _timing.enablePulse  = pgm_read_word(&timingPresets[preset][6]);
+}
 
-  case OLED_TYPE:
-    sendOledCommand(value);
-    break;
 
-  default:
+void I2cCharDisplay::setTiming(const I2cCharDisplayTiming &timing)
+{
+  _timing = timing;
+}
 
-    break;
+
+void I2cCharDisplay::getTiming(I2cCharDisplayTiming &timing)
+{
+  timing = _timing;
+}
+
+
+// Find the shortest commandDelay, clearDelay and enablePulse (lcd) that this display module handles reliably.
+// Each delay is binary searched between 0 and the delay being used now (which has to work): a delay works if
+// the characters written with it can be read back from the display TIMING_CALIBRATION_TRIALS times in a row.
+// A margin of 1/4 is added to the shortest delay that works (for changes in temperature and supply voltage).
+// The power up and reset delays can't be tested without turning the display off, so they are not changed.
+// The new timing is used, and returned in timing so that it can be saved (e.g. in EEPROM) and given to
+// setTiming() before begin() the next time.
+// The display is cleared. Returns false (and keeps the timing) if the display can't be read back
+// (e.g. an lcd backpack that doesn't connect the read/write pin of the lcd).
+bool I2cCharDisplay::calibrateTiming(I2cCharDisplayTiming &timing)
+{
+  I2cCharDisplayTiming original = _timing;
+  bool ok = calibrateDelay(TIMING_TEST_COMMAND, _timing.commandDelay) &&   // each delay is tested with the ones found before it
+            calibrateDelay(TIMING_TEST_CLEAR, _timing.clearDelay);
+
+  if (ok && _displayType == LCD_TYPE)
+  {
+    ok = calibrateDelay(TIMING_TEST_ENABLE, _timing.enablePulse);
+  }
+  if (!ok)
+  {
+    _timing = original;
   }
+  timing = _timing;
+
+  clear();
+  home();
+  return ok;
 }
 
 
-void I2cCharDisplay::sendData(uint8_t value)
+void I2cCharDisplay::setProbeInterval(uint16_t interval)
+{
+  _probeInterval = interval;
+}
+
+
+bool I2cCharDisplay::displayAttached()
+{
+  return _displayAttached;
+}
+
+
+// Re-initialize the display and then send the snapshot of the display state (custom characters,
+// contents, display control, entry mode, display shift, brightness and cursor position).
+// Only the parts of DDRAM that are not blank are sent.
+void I2cCharDisplay::restore()
 {
+  uint8_t displayControlCommand = _lcdDisplayControlCommand;
+  uint8_t entryModeCommand      = _lcdEntryModeCommand;
+  uint8_t addressCounter        = _addressCounter;
+  bool addressIsCgram           = _addressIsCgram;
+
+  _displayAttached = true;
   switch (_displayType)
   {
   case LCD_TYPE:
-    sendLcdData(value);
+    lcdBegin();
     break;
 
   case OLED_TYPE:
-    sendOledData(value);
+    oledBegin();
+    break;
+
+  case LCD_MCP23017_TYPE:
+    mcpBegin();
     break;
 
   default:
 
     break;
   }
-}
+  sendCommand(LCD_CLEARDISPLAYCOMMAND); // clear display (if the display kept its power, it still has the old contents)
+  waitMicroseconds(_timing.clearDelay);
 
-
-void I2cCharDisplay::i2cWrite1(uint8_t data){   // write one byte to i2c bus, either i2cPort 0 or 1
-  if (_i2cPort == 1) {
-    Wire1.beginTransmission(_i2cAddress);           // **** Start I2C
-    Wire1.write(data);
-    Wire1.endTransmission();                        // **** End I2C
-  }
-  else {
-    Wire.beginTransmission(_i2cAddress);           // **** Start I2C
-    Wire.write(data);
-    Wire.endTransmission();                        // **** End I2C
+  if (!_displayAttached)                // the display went away again, update() will try again later
+  {
+    return;
   }
-}
 
+  // custom characters, from the first to the last one that was written
+  if (_cgramUsed != 0)
+  {
+    uint8_t first = 0;
+    uint8_t last  = 7;
+    while (!(_cgramUsed & (1 << first)))
+    {
+      first++;
+    }
+    while (!(_cgramUsed & (1 << last)))
+    {
+      last--;
+    }
+    sendCharacters(first, last - first + 1);
+  }
 
-void I2cCharDisplay::i2cWrite2(uint8_t data1, uint8_t data2){  // write 2 bytes to the i2c bus, either i2cPort 0 or 1
-  if (_i2cPort == 1) {
-    Wire1.beginTransmission(_i2cAddress);           // **** Start I2C
-    Wire1.write(data1);
-    Wire1.write(data2);
-    Wire1.endTransmission();                        // **** End I2C
+  // contents of each DDRAM line (in the entry mode that the init left, left to right and no shift)
+  if (_rows == 1)
+  {
+    replayDdram(0x00, 0x50);
   }
-  else {
-    Wire.beginTransmission(_i2cAddress);           // **** Start I2C
-    Wire.write(data1);
-    Wire.write(data2);
-    Wire.endTransmission();                        // **** End I2C
+  else if (_rows > 2 && _displayType == OLED_TYPE)
+  {
+    replayDdram(0x00, 0x80);
+  }
+  else
+  {
+    replayDdram(0x00, 0x28);
+    replayDdram(0x40, 0x68);
   }
-}
 
+  _lcdEntryModeCommand = entryModeCommand;
+  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
 
-// sendCommand - send command to the display
-// value is what is sent
-void I2cCharDisplay::sendLcdCommand(uint8_t value)
-{
-  // we need to break the value into 2 bytes, high nibble and a low nibble to send to lcd
-  // and set the backlight bit which always need to be included.
-  uint8_t dataToSend[2];
+  _lcdDisplayControlCommand = displayControlCommand;
+  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
 
-  dataToSend[0] = (value & 0xf0) | _lcdBacklightControl | LCD_COMMAND;
-  dataToSend[1] = ((value << 4) & 0xf0) | _lcdBacklightControl | LCD_COMMAND;
+  for (int8_t i = 0; i < _displayShiftCount; ++i)
+  {
+    sendCommand(LCD_SHIFTCOMMAND | LCD_DISPLAYSHIFT | LCD_SHIFTRIGHT);
+  }
+  for (int8_t i = 0; i > _displayShiftCount; --i)
+  {
+    sendCommand(LCD_SHIFTCOMMAND | LCD_DISPLAYSHIFT | LCD_SHIFTLEFT);
+  }
 
+  if (_displayType == OLED_TYPE && _oledBrightness != 0xFF)    // oledBegin() sets the brightness to 0xFF
+  {
+    setBrightness(_oledBrightness);
+  }
 
-  // write the 2 bytes of data to the display
-  for (uint8_t i = 0; i < 2; ++i)
+  // put the cursor back
+  _addressCounter = addressCounter;
+  _addressIsCgram = addressIsCgram;
+  if (_addressIsCgram)
   {
-    i2cWrite1((int)(dataToSend[i]));
-    // set the enable bit and write again
-    i2cWrite1((int)(dataToSend[i]) | LCD_ENABLEON);
-    delayMicroseconds(1);               // hold enable high for 1us
-    // clear the enable bit and write again
-    i2cWrite1((int)(dataToSend[i]) | LCD_ENABLEOFF);
-    delayMicroseconds(1);           //
+    sendCommand(LCD_SETCGRAMADDRCOMMAND | _addressCounter);
+  }
+  else
+  {
+    sendCommand(LCD_SETDDRAMADDRCOMMAND | _addressCounter);
   }
 }
 
 
-// sendData - send data to the display
-// value is what is sent
-void I2cCharDisplay::sendLcdData(uint8_t value)
-{
-  // we need to break the value into 2 bytes, high nibble and a low nibble to send to lcd
-  // and set the backlight bit which always need to be included.
-  uint8_t dataToSend[2];
-
-  // add in the backlight setting and the data bit
-  dataToSend[0] = (value & 0xf0) | _lcdBacklightControl | LCD_DATA;
-  dataToSend[1] = ((value << 4) & 0xf0) | _lcdBacklightControl | LCD_DATA;
 
+// functions to interface with higher level Arduino and Particle functions (like Print)
 
-  // write the 2 bytes of data to the display
-  for (uint8_t i = 0; i < 2; ++i)
+// this allows the print command to be used to write to the display...
+// e.g. if your display class is myLcd, then you can use  myLcd.print("hello world");  to write to the lcd
+inline size_t I2cCharDisplay::write(uint8_t value)
+{
+  if (_charset != CHARSET_RAW)
   {
-    i2cWrite1((int)(dataToSend[i]));
-    // set the enable bit and write again
-    i2cWrite1((int)(dataToSend[i]) | LCD_ENABLEON);
-    delayMicroseconds(1);               // hold enable high for 1us
-    // clear the enable bit and write again
-    i2cWrite1((int)(dataToSend[i]) | LCD_ENABLEOFF);
-    delayMicroseconds(1);
+    int16_t character = decodeCharacter(value, _utf8Codepoint, _utf8Remaining);
+    if (character < 0)              // in the middle of a UTF-8 character
+    {
+      return 1;
+    }
+    value = character;
   }
+  sendData(value);
+  trackData(value);
+  return 1;         // we have printed one character
 }
 
 
-void I2cCharDisplay::sendOledCommand(uint8_t value)
+// print() uses this to send a whole string. The characters are collected and sent with
+// sendDataBulk(), so a short string goes out in one or a few i2c transmissions.
+size_t I2cCharDisplay::write(const uint8_t *buffer, size_t size)
 {
-  i2cWrite2(OLED_COMMANDMODE, value);
-  delay(10);
+  uint8_t characters[DISPLAY_I2C_BUFFER_SIZE];
+  uint8_t count = 0;
+
+  for (size_t i = 0; i < size; ++i)
+  {
+    uint8_t value = buffer[i];
+    if (_charset != CHARSET_RAW)
+    {
+      int16_t character = decodeCharacter(value, _utf8Codepoint, _utf8Remaining);
+      if (character < 0)            // in the middle of a UTF-8 character
+      {
+        continue;
+      }
+      value = character;
+    }
+    characters[count++] = value;
+    trackData(value);
+    if (count == DISPLAY_I2C_BUFFER_SIZE)
+    {
+      sendDataBulk(characters, count);
+      count = 0;
+    }
+  }
+  sendDataBulk(characters, count);
+  return size;
 }
 
 
-void I2cCharDisplay::sendOledData(uint8_t value)
+// Choose how printed text is changed into the character codes of the display ROM.
+// CHARSET_RAW (DEFAULT) sends the bytes as they are. The other charsets decode UTF-8 text and use
+// a table for the lcd display ROM, so that text like "25°C" or "5µs" prints correctly.
+// There is no table for the US2066 oled ROMs yet: CHARSET_US2066_ASCII prints the ASCII characters, and
+// the other codepoints show the replacement character unless they are added with mapCharacter().
+void I2cCharDisplay::setCharset(uint8_t charset)
 {
-  i2cWrite2(OLED_DATAMODE, value);
+  if (charset > CHARSET_US2066_ASCII)
+  {
+    charset = CHARSET_RAW;
+  }
+  _charset       = charset;
+  _utf8Remaining = 0;
 }
 
 
-void I2cCharDisplay::oledBegin()
+// Add a character to the charset: when codepoint is printed, character is sent to the display.
+// This is useful for characters that the display ROM doesn't have, e.g.
+//   myDisplay.createCharacter(0, degreeMap);
+//   myDisplay.mapCharacter(0x00B0, 0);     // print ° with custom character 0
+// A codepoint that is mapped again gets the new character.
+#if DISPLAY_MAPPEDCHARACTERS > 0
+void I2cCharDisplay::mapCharacter(uint16_t codepoint, uint8_t character)
 {
-  delay(100);       // wait for the display to power up
-
-  // begin OLED setup
-  sendCommand(0x2A); // Set RE bit (RE=1, IS=0, SD=0)
-
-  sendCommand(0x71); // Function Selection A
-  sendData(0x5C);    // 5C = enable regulator (for 5V I/O), 00 = disable regulator (for 3.3V I/O)
-                     //      Leave at 5C and then you can operate at either 3.3 or 5 volts.
-                     //      The current draw of the regulator is minimal
-
-  sendCommand(0x28); // Clear RE bit (RE=0, IS=0, SD=0)
-
-  sendCommand(0x08); // Sleep Mode On (display, cursor & blink are off) during this setup
+  for (uint8_t i = 0; i < DISPLAY_MAPPEDCHARACTERS; ++i)
+  {
+    if (_mappedCodepoints[i] == codepoint || _mappedCodepoints[i] == 0)
+    {
+      _mappedCodepoints[i] = codepoint;
+      _mappedCharacters[i] = character;
+      return;
+    }
+  }
+}
+#else
+void I2cCharDisplay::mapCharacter(uint16_t, uint8_t)
+{
+}
+#endif
 
-  sendCommand(0x2A); // Set RE bit (RE=1, IS=0, SD=0)
-  sendCommand(0x79); // Set SD bit (RE=1, IS=0, SD=1)
 
-  sendCommand(0xD5); // Set Display Clock Divide Ratio/ Oscillator Frequency
-  sendCommand(0x70); //     set the Freq to 70h
+// functions that work with both OLED and LCD
 
-  sendCommand(0x78); // Clear SD bit (RE=1, IS=0, SD=0)
+void I2cCharDisplay::clear()
+{
+  sendCommand(LCD_CLEARDISPLAYCOMMAND); // clear display
+  waitMicroseconds(_timing.clearDelay);
+  clearSnapshot();
+  _lcdEntryModeCommand |= LCD_DISPLAYLEFTTORIGHT;  // clear also sets the entry mode to left to right (the shift setting stays)
 
-  // Extended Function Set:
-    if (_rows > 2)
+  if (hasSignature())                   // clear also erased the signature, so put it back
+  {
+    if (_lcdEntryModeCommand & LCD_DISPLAYSHIFTON)   // without shifting the display when it is written
     {
-      sendCommand(0x09); // Set 5x8 chars, display inversion cleared, 3/4 line display
+      sendCommand(LCD_ENTRYMODECOMMAND | LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF);
+      writeSignature();
+      sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
     }
     else
     {
-      sendCommand(0x08); // Set 5x8 chars, cursor inversion cleared, 1/2 line display
+      writeSignature();
     }
+  }
+}
 
-  sendCommand(0x06); // Set Advanced Entry Mode: COM0 -> COM31, SEG99 -> SEG0
-
-  sendCommand(0x72); // Function Selection B:
-  sendData(0x00);    //    Select ROM A and CGRAM 8 (which allows for custom characters)
 
-  sendCommand(0x79); // Set SD bit  (RE=1, IS=0, SD=1)
+void I2cCharDisplay::home()
+{
+  cursorMove(1, 1);    // use move command instead to avoid flicker on oled displays
+  //  sendCommand(LCD_RETURNHOMECOMMAND); // move cursor to home
+  //  delayMicroseconds(2000);            // 1.53ms required
+}
 
-  sendCommand(0xDA); // Set SEG Pins Hardware Configuration:
-  sendCommand(0x10); //      Enable SEG Left, Seq SEG pin config
 
-  sendCommand(0xDC); // Function Selection C
-  sendCommand(0x00); //   Internal VSL, GPIO pin HiZ, input disabled
+// move cursor to new postion row,col  (both start at 1)
+void I2cCharDisplay::cursorMove(uint8_t row, uint8_t col)
+{
+  uint8_t address = ddramAddress(row, col);
 
-  sendCommand(0x81); // Set Contrast (brightness)
-  sendCommand(0xFF); //       max value = 0xFF
+  sendCommand(LCD_SETDDRAMADDRCOMMAND | address);
+  _addressCounter = address & 0x7F;
+  _addressIsCgram = false;
+}
 
-  sendCommand(0xD9); // Set Phase Length
-  sendCommand(0xF1); //       Phase 2 = 15(F), Phase 1 = 1   (power on = 0x78)
 
-  sendCommand(0xDB); // set VCOMH deselect Level
-  sendCommand(0x40); //       1 x Vcc  (previously 0x30)
+// display on/off
+void I2cCharDisplay::displayOff()
+{
+  _lcdDisplayControlCommand &= ~LCD_DISPLAYON;
+  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+}
 
-  // Done with OLED Setup
 
-  sendCommand(0x78);    // Clear SD bit  (RE=1, IS=0, SD=0)
-  sendCommand(0x28);    // Clear RE and IS (RE=0, IS=0, SD=0)
+void I2cCharDisplay::displayOn()
+{
+  _lcdDisplayControlCommand |= LCD_DISPLAYON;
+  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+}
 
-  sendCommand(0x01);   // clear display
-  sendCommand(0x80);   // Set DDRAM Address to 0x80 (line 1 start)
 
-  delay(100);
+// cursor on/off
+void I2cCharDisplay::cursorOff()
+{
+  _lcdDisplayControlCommand &= ~LCD_CURSORON;
+  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+}
 
-  // send the function set command
-  _lcdFunctionSetCommand = LCD_1LINES | LCD_5x8DOTS;
-  if (_rows > 1)
-  {
-    _lcdFunctionSetCommand |= LCD_2LINES;
-  }
-  sendCommand(LCD_FUNCTIONSETCOMMAND | _lcdFunctionSetCommand);
 
-  // send the display command
-  // display on, no cursor and no blinking
-  _lcdDisplayControlCommand = LCD_DISPLAYON | LCD_CURSOROFF | LCD_CURSORBLINKOFF;
+void I2cCharDisplay::cursorOn()
+{
+  _lcdDisplayControlCommand |= LCD_CURSORON;
   sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+}
 
-  // send the entry mode command
-  _lcdEntryModeCommand = LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF;
-  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
 
-  // clear display and home cursor
-  clear();
+// cursor blink on/off
+void I2cCharDisplay::cursorBlinkOff()
+{
+  _lcdDisplayControlCommand &= ~LCD_CURSORBLINKON;
+  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+}
+
+
+void I2cCharDisplay::cursorBlinkOn()
+{
+  _lcdDisplayControlCommand |= LCD_CURSORBLINKON;
+  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+}
+
+
+// display shift left/right (also shifts the cursor)
+void I2cCharDisplay::displayShiftLeft(void)
+{
+  sendCommand(LCD_SHIFTCOMMAND | LCD_DISPLAYSHIFT | LCD_SHIFTLEFT);
+  if (--_displayShiftCount <= -40)      // a line is 40 characters long, so 40 shifts is back where we started
+  {
+    _displayShiftCount = 0;
+  }
+}
+
+
+void I2cCharDisplay::displayShiftRight(void)
+{
+  sendCommand(LCD_SHIFTCOMMAND | LCD_DISPLAYSHIFT | LCD_SHIFTRIGHT);
+  if (++_displayShiftCount >= 40)
+  {
+    _displayShiftCount = 0;
+  }
+}
+
+
+// cursor shift left/right and change the address counter
+void I2cCharDisplay::cursorShiftLeft(void)
+{
+  sendCommand(LCD_SHIFTCOMMAND | LCD_CURSORSHIFT | LCD_SHIFTLEFT);
+  advanceAddress(false);
+}
+
+
+void I2cCharDisplay::cursorShiftRight(void)
+{
+  sendCommand(LCD_SHIFTCOMMAND | LCD_CURSORSHIFT | LCD_SHIFTRIGHT);
+  advanceAddress(true);
+}
+
+
+// set text to flow left to right (DEFAULT MODE)
+void I2cCharDisplay::displayLeftToRight(void)
+{
+  _lcdEntryModeCommand |= LCD_DISPLAYLEFTTORIGHT;
+  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+}
+
+
+// set text to flow right to left
+void I2cCharDisplay::displayRightToLeft(void)
+{
+  _lcdEntryModeCommand &= ~LCD_DISPLAYLEFTTORIGHT;
+  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+}
+
+
+// entire display shifts when new data is written to display
+void I2cCharDisplay::displayShiftOn(void)
+{
+  _lcdEntryModeCommand |= LCD_DISPLAYSHIFTON;
+  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+}
+
+
+// entire display does not shift when new data is written to display (NORMAL MODE)
+void I2cCharDisplay::displayShiftOff(void)
+{
+  _lcdEntryModeCommand &= ~LCD_DISPLAYSHIFTON;
+  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+}
+
+
+// Fill one of the 8 CGRAM memory addresses (0-7) to create custom characters
+void I2cCharDisplay::createCharacter(uint8_t address, uint8_t characterMap[])
+{
+  address &= 0x7;       // limit to the first 8 addresses
+  sendCommand(LCD_SETCGRAMADDRCOMMAND | (address << 3));
+  _addressCounter = address << 3;
+  _addressIsCgram = true;
+  for (uint8_t i = 0; i < 8; i++)
+  {
+    write(characterMap[i]);
+  }
+}
+
+
+// Fill count of the 8 CGRAM custom characters, starting at first (0-7), from an array of character maps, e.g.
+//   uint8_t icons[3][8] = { {...}, {...}, {...} };
+//   myDisplay.createCharacters(icons, 0, 3);
+// The CGRAM address is set once and all of the bytes are sent in as few i2c transmissions as possible.
+// Unlike createCharacter(), the cursor is put back where it was, so you can keep printing.
+void I2cCharDisplay::createCharacters(const uint8_t characterMaps[][8], uint8_t first, uint8_t count)
+{
+  first &= 0x7;                     // limit to the first 8 addresses
+  if (count > 8 - first)
+  {
+    count = 8 - first;
+  }
+  memcpy(&_cgram[first << 3], characterMaps, count << 3);
+  sendCharacters(first, count);
+}
+
+
+// same as createCharacters(), but the character maps are in flash, e.g.
+//   const uint8_t icons[3][8] PROGMEM = { {...}, {...}, {...} };
+void I2cCharDisplay::createCharacters_P(const uint8_t characterMaps[][8], uint8_t first, uint8_t count)
+{
+  first &= 0x7;                     // limit to the first 8 addresses
+  if (count > 8 - first)
+  {
+    count = 8 - first;
+  }
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    for (uint8_t j = 0; j < 8; ++j)
+    {
+      _cgram[((first + i) << 3) + j] = pgm_read_byte(&characterMaps[i][j]);
+    }
+  }
+  sendCharacters(first, count);
+}
+
+
+// functions specific to LCD displays
+
+
+
+// Turn the lcd backlight off/on
+void I2cCharDisplay::backlightOff(void)
+{
+  _lcdBacklightControl = LCD_BACKLIGHTOFF;
+  if (_displayType == LCD_MCP23017_TYPE)
+  {
+    i2cWrite2(MCP23017_GPIOA, _lcdBacklightControl);
+  }
+  else
+  {
+    i2cWrite1((int)(_lcdBacklightControl));
+  }
+}
+
+
+void I2cCharDisplay::backlightOn(void)
+{
+  _lcdBacklightControl = LCD_BACKLIGHTON;
+  if (_displayType == LCD_MCP23017_TYPE)
+  {
+    i2cWrite2(MCP23017_GPIOA, _lcdBacklightControl);
+  }
+  else
+  {
+    i2cWrite1((int)(_lcdBacklightControl));
+  }
+}
+
+
+// functions specific to OLED displays
+
+void I2cCharDisplay::setBrightness(uint8_t value)
+{
+  _fadeRunning = false;     // a brightness that is set stops a fade that is running
+  sendOledExtendedCommand(OLED_SETBRIGHTNESSCOMMAND, value);
+  _oledBrightness = value;
+}
+
+// Set the oled fade out feature to OFF
+void I2cCharDisplay::fadeOff()
+{
+  sendOledExtendedCommand(OLED_SETFADECOMMAND, OLED_FADEOFF);                     // set fade feature to OFF
+}
+
+// Set the oled fade out feature to ON (value is the rate of fade 0-15)
+void I2cCharDisplay::fadeOnce(uint8_t value)
+{
+  sendOledExtendedCommand(OLED_SETFADECOMMAND, OLED_FADEON | (0x0f & value));      // set fade feature to ON with a delay interval of value
+}
+
+// Set the oled fade out feature to BLINK (value is the rate of fade 0-15)
+void I2cCharDisplay::fadeBlink(uint8_t value)
+{
+  sendOledExtendedCommand(OLED_SETFADECOMMAND, OLED_FADEBLINK | (0x0f & value));      // set fade feature to BLINK with a delay interval of value
+}
+
+// Change the oled brightness smoothly from where it is now to brightness, over fadeTime ms.
+// This doesn't wait, update() sends a brightness step whenever it is due (at most every OLED_FADESTEPTIME ms),
+// so update() must be called often while the fade runs.
+// curve is FADE_LINEAR, FADE_EASEIN (starts slow), FADE_EASEOUT (ends slow) or FADE_EASEINOUT.
+void I2cCharDisplay::fadeBrightness(uint8_t brightness, uint16_t fadeTime, uint8_t curve)
+{
+  if (_displayType != OLED_TYPE)
+  {
+    return;
+  }
+  _fadeStartBrightness = _oledBrightness;
+  _fadeEndBrightness   = brightness;
+  _fadeCurve           = curve;
+  _fadeTime            = fadeTime;
+  _fadeStartTime       = millis();
+  _fadeStepTime        = _fadeStartTime;
+  _fadeRunning         = true;
+  stepBrightnessFade();
+}
+
+
+bool I2cCharDisplay::fadeBrightnessRunning()
+{
+  return _fadeRunning;
+}
+
+
+
+
+
+
+// private functions ********************************
+
+
+// the setup shared by the constructors (nothing is sent to the display until begin())
+void I2cCharDisplay::init(uint8_t displayType, uint8_t i2cAddress, uint8_t rows, uint8_t i2cPort)
+{
+  _displayType         = displayType;
+  _i2cAddress          = i2cAddress;
+  _i2cPort             = i2cPort;
+  _rows                = rows;
+  _lcdBacklightControl = LCD_BACKLIGHTON;
+  setTiming((displayType == OLED_TYPE) ? TIMING_US2066_SAFE : TIMING_HD44780_SAFE);
+
+  clearSnapshot();
+  memset(_cgram, 0, DISPLAY_CGRAM_SIZE);
+  _cgramUsed           = 0;
+  _oledBrightness      = 0xFF;
+  _displayAttached     = true;
+  _displayReadable     = true;
+  _probeInterval       = DISPLAY_PROBE_INTERVAL;
+  _hotPlug             = false;
+  _lastProbeTime       = 0;
+#if DISPLAY_MARQUEES > 0
+  for (uint8_t i = 0; i < DISPLAY_MARQUEES; ++i)
+  {
+    _marquees[i].text  = NULL;
+  }
+#endif
+  _fadeRunning         = false;
+  _animation           = NULL;
+  _cellsSent           = false;
+  _charset             = CHARSET_RAW;
+  _utf8Remaining       = 0;
+#if DISPLAY_MAPPEDCHARACTERS > 0
+  for (uint8_t i = 0; i < DISPLAY_MAPPEDCHARACTERS; ++i)
+  {
+    _mappedCodepoints[i] = 0;
+  }
+#endif
+#if DISPLAY_LAYERS > 0
+  for (uint8_t i = 0; i < DISPLAY_LAYERS; ++i)
+  {
+    _layers[i]         = NULL;
+  }
+  for (uint8_t i = 0; i < DISPLAY_MAX_ROWS; ++i)
+  {
+    _damageLeft[i]     = 0xFF;
+    _damageRight[i]    = 0;
+  }
+#endif
+#if DISPLAY_QUEUE_SIZE > 0
+  _queueHead           = 0;
+  _queueTail           = 0;
+  _queueOverflows      = 0;
+#endif
+#if DISPLAY_FIELDS > 0
+  for (uint8_t i = 0; i < DISPLAY_FIELDS; ++i)
+  {
+    _fields[i].width   = 0;
+  }
+  _fieldsChanged       = 0;
+  _fieldsFlush         = false;
+  _fieldInterval       = 0;
+  _fieldDrawTime       = 0;
+#endif
+  _referenceMode       = false;
+  _i2cTransactions     = 0;
+}
+
+
+void I2cCharDisplay::sendCommand(uint8_t value)
+{
+  switch (_displayType)
+  {
+  case LCD_TYPE:
+    sendLcdCommand(value);
+    break;
+
+  case OLED_TYPE:
+    sendOledCommand(value);
+    break;
+
+  case LCD_MCP23017_TYPE:
+    sendMcpCommand(value);
+    break;
+
+  default:
+
+    break;
+  }
+}
+
+
+void I2cCharDisplay::sendData(uint8_t value)
+{
+  switch (_displayType)
+  {
+  case LCD_TYPE:
+    sendLcdData(value);
+    break;
+
+  case OLED_TYPE:
+    sendOledData(value);
+    break;
+
+  case LCD_MCP23017_TYPE:
+    sendMcpData(value);
+    break;
+
+  default:
+
+    break;
+  }
+}
+
+
+// Once update() checks the display (see setProbeInterval()), the write functions stop sending when the
+// display doesn't acknowledge (it was unplugged), and update() restores it when it comes back. Without
+// update() they keep sending, so a glitch on the bus only loses the write that it hit.
+void I2cCharDisplay::i2cWrite1(uint8_t data){   // write one byte to i2c bus, either i2cPort 0 or 1
+  if (!_displayAttached && _hotPlug)
+    return;
+  _i2cTransactions++;
+  if (_i2cPort == 1) {
+    Wire1.beginTransmission(_i2cAddress);           // **** Start I2C
+    Wire1.write(data);
+    _displayAttached = (Wire1.endTransmission() == 0);  // **** End I2C
+  }
+  else {
+    Wire.beginTransmission(_i2cAddress);           // **** Start I2C
+    Wire.write(data);
+    _displayAttached = (Wire.endTransmission() == 0);  // **** End I2C
+  }
+}
+
+
+void I2cCharDisplay::i2cWrite2(uint8_t data1, uint8_t data2){  // write 2 bytes to the i2c bus, either i2cPort 0 or 1
+  if (!_displayAttached && _hotPlug)
+    return;
+  _i2cTransactions++;
+  if (_i2cPort == 1) {
+    Wire1.beginTransmission(_i2cAddress);           // **** Start I2C
+    Wire1.write(data1);
+    Wire1.write(data2);
+    _displayAttached = (Wire1.endTransmission() == 0);  // **** End I2C
+  }
+  else {
+    Wire.beginTransmission(_i2cAddress);           // **** Start I2C
+    Wire.write(data1);
+    Wire.write(data2);
+    _displayAttached = (Wire.endTransmission() == 0);  // **** End I2C
+  }
+}
+
+
+void I2cCharDisplay::i2cWriteN(const uint8_t *data, uint8_t count){  // write count bytes to the i2c bus in one transmission, either i2cPort 0 or 1
+  if (!_displayAttached && _hotPlug)
+    return;
+  _i2cTransactions++;
+  if (_i2cPort == 1) {
+    Wire1.beginTransmission(_i2cAddress);           // **** Start I2C
+    for (uint8_t i = 0; i < count; ++i)
+      Wire1.write(data[i]);
+    _displayAttached = (Wire1.endTransmission() == 0);  // **** End I2C
+  }
+  else {
+    Wire.beginTransmission(_i2cAddress);           // **** Start I2C
+    for (uint8_t i = 0; i < count; ++i)
+      Wire.write(data[i]);
+    _displayAttached = (Wire.endTransmission() == 0);  // **** End I2C
+  }
+}
+
+
+bool I2cCharDisplay::i2cProbe(){  // returns true if the display acknowledges its i2c address
+  _i2cTransactions++;
+  if (_i2cPort == 1) {
+    Wire1.beginTransmission(_i2cAddress);           // **** Start I2C
+    return (Wire1.endTransmission() == 0);          // **** End I2C
+  }
+  else {
+    Wire.beginTransmission(_i2cAddress);           // **** Start I2C
+    return (Wire.endTransmission() == 0);          // **** End I2C
+  }
+}
+
+
+uint8_t I2cCharDisplay::i2cRead(uint8_t *data, uint8_t count){  // read count bytes from the i2c bus, returns the number of bytes read
+  uint8_t received = 0;
+
+  _i2cTransactions++;
+  if (_i2cPort == 1) {
+    Wire1.requestFrom(_i2cAddress, count);
+    while (Wire1.available() && received < count)
+      data[received++] = Wire1.read();
+  }
+  else {
+    Wire.requestFrom(_i2cAddress, count);
+    while (Wire.available() && received < count)
+      data[received++] = Wire.read();
+  }
+  return received;
+}
+
+
+uint8_t I2cCharDisplay::i2cWriteRead(uint8_t control, uint8_t *data, uint8_t count){  // write a control byte, then read count bytes (repeated start)
+  _i2cTransactions++;
+  if (_i2cPort == 1) {
+    Wire1.beginTransmission(_i2cAddress);           // **** Start I2C
+    Wire1.write(control);
+    if (Wire1.endTransmission(false) != 0)          // no stop, the read follows with a repeated start
+      return 0;                                     // the display did not acknowledge
+  }
+  else {
+    Wire.beginTransmission(_i2cAddress);           // **** Start I2C
+    Wire.write(control);
+    if (Wire.endTransmission(false) != 0)          // no stop, the read follows with a repeated start
+      return 0;                                    // the display did not acknowledge
+  }
+  return i2cRead(data, count);
+}
+
+
+// sendCommand - send command to the display
+// value is what is sent
+void I2cCharDisplay::sendLcdCommand(uint8_t value)
+{
+  // we need to break the value into 2 bytes, high nibble and a low nibble to send to lcd
+  // and set the backlight bit which always need to be included.
+  uint8_t dataToSend[2];
+
+  dataToSend[0] = (value & 0xf0) | _lcdBacklightControl | LCD_COMMAND;
+  dataToSend[1] = ((value << 4) & 0xf0) | _lcdBacklightControl | LCD_COMMAND;
+
+
+  // write the 2 bytes of data to the display
+  for (uint8_t i = 0; i < 2; ++i)
+  {
+    i2cWrite1((int)(dataToSend[i]));
+    // set the enable bit and write again
+    i2cWrite1((int)(dataToSend[i]) | LCD_ENABLEON);
+    waitMicroseconds(_timing.enablePulse);   // hold enable high
+    // clear the enable bit and write again
+    i2cWrite1((int)(dataToSend[i]) | LCD_ENABLEOFF);
+    waitMicroseconds(_timing.enablePulse);
+  }
+  waitMicroseconds(_timing.commandDelay);
+}
+
+
+// sendData - send data to the display
+// value is what is sent
+void I2cCharDisplay::sendLcdData(uint8_t value)
+{
+  // we need to break the value into 2 bytes, high nibble and a low nibble to send to lcd
+  // and set the backlight bit which always need to be included.
+  uint8_t dataToSend[2];
+
+  // add in the backlight setting and the data bit
+  dataToSend[0] = (value & 0xf0) | _lcdBacklightControl | LCD_DATA;
+  dataToSend[1] = ((value << 4) & 0xf0) | _lcdBacklightControl | LCD_DATA;
+
+
+  // write the 2 bytes of data to the display
+  for (uint8_t i = 0; i < 2; ++i)
+  {
+    i2cWrite1((int)(dataToSend[i]));
+    // set the enable bit and write again
+    i2cWrite1((int)(dataToSend[i]) | LCD_ENABLEON);
+    waitMicroseconds(_timing.enablePulse);   // hold enable high
+    // clear the enable bit and write again
+    i2cWrite1((int)(dataToSend[i]) | LCD_ENABLEOFF);
+    waitMicroseconds(_timing.enablePulse);
+  }
+}
+
+
+void I2cCharDisplay::sendOledCommand(uint8_t value)
+{
+  i2cWrite2(OLED_COMMANDMODE, value);
+  waitMicroseconds(_timing.commandDelay);
+}
+
+
+void I2cCharDisplay::sendOledData(uint8_t value)
+{
+  i2cWrite2(OLED_DATAMODE, value);
+}
+
+
+void I2cCharDisplay::sendMcpCommand(uint8_t value)
+{
+  sendMcpByte(value, LCD_COMMAND);
+  waitMicroseconds(_timing.commandDelay);
+}
+
+
+void I2cCharDisplay::sendMcpData(uint8_t value)
+{
+  sendMcpByte(value, LCD_DATA);
+}
+
+
+void I2cCharDisplay::oledBegin()
+{
+  delay(_timing.powerUpDelay);       // wait for the display to power up
+
+  // begin OLED setup
+  sendCommand(0x2A); // Set RE bit (RE=1, IS=0, SD=0)
+
+  sendCommand(0x71); // Function Selection A
+  sendData(0x5C);    // 5C = enable regulator (for 5V I/O), 00 = disable regulator (for 3.3V I/O)
+                     //      Leave at 5C and then you can operate at either 3.3 or 5 volts.
+                     //      The current draw of the regulator is minimal
+
+  sendCommand(0x28); // Clear RE bit (RE=0, IS=0, SD=0)
+
+  sendCommand(0x08); // Sleep Mode On (display, cursor & blink are off) during this setup
+
+  sendCommand(0x2A); // Set RE bit (RE=1, IS=0, SD=0)
+  sendCommand(0x79); // Set SD bit (RE=1, IS=0, SD=1)
+
+  sendCommand(0xD5); // Set Display Clock Divide Ratio/ Oscillator Frequency
+  sendCommand(0x70); //     set the Freq to 70h
+
+  sendCommand(0x78); // Clear SD bit (RE=1, IS=0, SD=0)
+
+  // Extended Function Set:
+    if (_rows > 2)
+    {
+      sendCommand(0x09); // Set 5x8 chars, display inversion cleared, 3/4 line display
+    }
+    else
+    {
+      sendCommand(0x08); // Set 5x8 chars, cursor inversion cleared, 1/2 line display
+    }
+
+  sendCommand(0x06); // Set Advanced Entry Mode: COM0 -> COM31, SEG99 -> SEG0
+
+  sendCommand(0x72); // Function Selection B:
+  sendData(0x00);    //    Select ROM A and CGRAM 8 (which allows for custom characters)
+
+  sendCommand(0x79); // Set SD bit  (RE=1, IS=0, SD=1)
+
+  sendCommand(0xDA); // Set SEG Pins Hardware Configuration:
+  sendCommand(0x10); //      Enable SEG Left, Seq SEG pin config
+
+  sendCommand(0xDC); // Function Selection C
+  sendCommand(0x00); //   Internal VSL, GPIO pin HiZ, input disabled
+
+  sendCommand(0x81); // Set Contrast (brightness)
+  sendCommand(0xFF); //       max value = 0xFF
+
+  sendCommand(0xD9); // Set Phase Length
+  sendCommand(0xF1); //       Phase 2 = 15(F), Phase 1 = 1   (power on = 0x78)
+
+  sendCommand(0xDB); // set VCOMH deselect Level
+  sendCommand(0x40); //       1 x Vcc  (previously 0x30)
+
+  // Done with OLED Setup
+
+  sendCommand(0x78);    // Clear SD bit  (RE=1, IS=0, SD=0)
+  sendCommand(0x28);    // Clear RE and IS (RE=0, IS=0, SD=0)
+
+  sendCommand(0x01);   // clear display
+  waitMicroseconds(_timing.clearDelay);
+  sendCommand(0x80);   // Set DDRAM Address to 0x80 (line 1 start)
+
+  delay(_timing.setupDelay);
+
+  // send the function set command
+  _lcdFunctionSetCommand = LCD_1LINES | LCD_5x8DOTS;
+  if (_rows > 1)
+  {
+    _lcdFunctionSetCommand |= LCD_2LINES;
+  }
+  sendCommand(LCD_FUNCTIONSETCOMMAND | _lcdFunctionSetCommand);
+
+  // send the display command
+  // display on, no cursor and no blinking
+  _lcdDisplayControlCommand = LCD_DISPLAYON | LCD_CURSOROFF | LCD_CURSORBLINKOFF;
+  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+
+  // send the entry mode command
+  _lcdEntryModeCommand = LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF;
+  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+}
+
+
+void I2cCharDisplay::lcdBegin()
+{
+  uint8_t data;
+
+
+/*
+ * // enable i2c if it is not already
+ * if (!Wire.isEnabled())
+ * {
+ *  Wire.begin();
+ * }
+ */
+// initialize the lcd
+  delay(_timing.powerUpDelay);           // wait for lcd to power up
+
+  // set all of the outputs on the PCA8574 chip to 0, except the backlight bit if on
+  data = _lcdBacklightControl;
+  i2cWrite1((int)(data));
+  delay(_timing.setupDelay);
+
+  // put lcd in 4 bit mode
+  lcdWriteNibble(0x30);
+  waitMicroseconds(_timing.resetDelay);  // wait min 4.1ms
+
+  // put lcd in 4 bit mode again
+  lcdWriteNibble(0x30);
+  waitMicroseconds(_timing.resetDelay);  // wait min 4.1ms
+
+  // put lcd in 4 bit mode again
+  lcdWriteNibble(0x30);
+  waitMicroseconds(_timing.resetDelay);  // wait min 4.1ms
+
+
+  // set up 4 bit interface
+  lcdWriteNibble(0x20);
+
+
+
+  // send the function set command
+  _lcdFunctionSetCommand = LCD_4BITMODE | LCD_1LINES | LCD_5x8DOTS;
+  if (_rows > 1)
+  {
+    _lcdFunctionSetCommand |= LCD_2LINES;
+  }
+  sendCommand(LCD_FUNCTIONSETCOMMAND | _lcdFunctionSetCommand);
+
+  // send the display command
+  // display on, no cursor and no blinking
+  _lcdDisplayControlCommand = LCD_DISPLAYON | LCD_CURSOROFF | LCD_CURSORBLINKOFF;
+  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+
+  // send the entry mode command
+  _lcdEntryModeCommand = LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF;
+  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+}
+
+
+// the lcd kept its power, but we don't know what it was doing when the microcontroller was reset,
+// so re-synchronize the 4 bit interface (without the long power up delays) and then restore
+// the same display settings that lcdBegin() uses. The contents of the display are not cleared.
+void I2cCharDisplay::lcdWarmBegin()
+{
+  // the reset could have happened between the two nibbles of a byte, so start with 8 bit mode again
+  lcdWriteNibble(0x30);
+  waitMicroseconds(_timing.resetDelay);  // wait min 4.1ms (in case the lcd was busy with a clear command)
+  lcdWriteNibble(0x30);
+  waitMicroseconds(_timing.resyncDelay);
+  lcdWriteNibble(0x30);
+  waitMicroseconds(_timing.resyncDelay);
+
+  // set up 4 bit interface
+  lcdWriteNibble(0x20);
+
+  // send the function set command
+  _lcdFunctionSetCommand = LCD_4BITMODE | LCD_1LINES | LCD_5x8DOTS;
+  if (_rows > 1)
+  {
+    _lcdFunctionSetCommand |= LCD_2LINES;
+  }
+  sendCommand(LCD_FUNCTIONSETCOMMAND | _lcdFunctionSetCommand);
+
+  // send the display command
+  // display on, no cursor and no blinking
+  _lcdDisplayControlCommand = LCD_DISPLAYON | LCD_CURSOROFF | LCD_CURSORBLINKOFF;
+  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+
+  // send the entry mode command
+  _lcdEntryModeCommand = LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF;
+  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+
+  home();
+}
+
+
+// the oled kept its power and still holds its configuration (checked by oledConfigured()),
+// so only restore the same display settings that oledBegin() uses. The contents of the display are not cleared.
+void I2cCharDisplay::oledWarmBegin()
+{
+  _ddram[signatureAddress()]     = DISPLAY_SIGNATURE1;     // the signature is still there, keep it in the snapshot
+  _ddram[signatureAddress() + 1] = DISPLAY_SIGNATURE2;
+
+  // send the function set command
+  _lcdFunctionSetCommand = LCD_1LINES | LCD_5x8DOTS;
+  if (_rows > 1)
+  {
+    _lcdFunctionSetCommand |= LCD_2LINES;
+  }
+  sendCommand(LCD_FUNCTIONSETCOMMAND | _lcdFunctionSetCommand);
+
+  // send the display command
+  // display on, no cursor and no blinking
+  _lcdDisplayControlCommand = LCD_DISPLAYON | LCD_CURSOROFF | LCD_CURSORBLINKOFF;
+  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+
+  // send the entry mode command
+  _lcdEntryModeCommand = LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF;
+  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+
+  home();
+}
+
+
+// The PCA8574 outputs all go high when it powers up, which would leave the lcd enable and read bits set.
+// After lcdBegin() (and every write since) the enable and read bits are always left low, so if we can
+// still read them back as low, the backpack and lcd have kept their power since they were initialized.
+bool I2cCharDisplay::lcdConfigured()
+{
+  uint8_t data;
+
+  if (i2cRead(&data, 1) != 1)         // the backpack didn't answer
+  {
+    return false;
+  }
+  if ((data & (LCD_ENABLEON | LCD_READ)) != 0)
+  {
+    return false;
+  }
+
+  _lcdBacklightControl = data & LCD_BACKLIGHTON;  // keep the backlight the way it was
+  return true;
+}
+
+
+// Read the busy flag and address counter to see if the oled is answering and ready, then look for
+// the signature that oledBegin() (and clear()) leave in a DDRAM location that is not shown on the display.
+bool I2cCharDisplay::oledConfigured()
+{
+  uint8_t data[3];
+
+  if (i2cWriteRead(OLED_COMMANDSTREAM, data, 1) != 1)  // the oled didn't answer
+  {
+    return false;
+  }
+  if (data[0] & 0x80)                                // the busy flag is still set (the oled is still starting up)
+  {
+    return false;
+  }
+
+  // the reset could have happened in the middle of an extended command (e.g. setBrightness()),
+  // so make sure that we are back to RE=0, IS=0, SD=0 before using the normal commands
+  sendCommand(0x2A);   // Set RE bit (RE=1, IS=0, SD=0)
+  sendCommand(0x78);   // Clear SD bit (RE=1, IS=0, SD=0)
+  sendCommand(0x28);   // Clear RE and IS (RE=0, IS=0, SD=0)
+
+  sendCommand(LCD_SETDDRAMADDRCOMMAND | signatureAddress());
+  if (i2cWriteRead(OLED_DATAMODE, data, 3) != 3)
+  {
+    return false;
+  }
+
+  // some modules return a dummy byte before the data, so accept the signature at either position
+  if (data[0] == DISPLAY_SIGNATURE1 && data[1] == DISPLAY_SIGNATURE2)
+  {
+    return true;
+  }
+  return (data[1] == DISPLAY_SIGNATURE1 && data[2] == DISPLAY_SIGNATURE2);
+}
+
+
+// write the high nibble of data to the lcd (with the enable pulse), used during the initialization
+// when the lcd may not be in 4 bit mode yet
+void I2cCharDisplay::lcdWriteNibble(uint8_t data)
+{
+  data = (data & 0xf0) | _lcdBacklightControl;
+  i2cWrite1((int)(data));
+  // set the enable bit and write again
+  i2cWrite1((int)(data | LCD_ENABLEON));
+  waitMicroseconds(_timing.enablePulse);   // hold enable high
+  // clear the enable bit and write again
+  i2cWrite1((int)(data | LCD_ENABLEOFF));
+  waitMicroseconds(_timing.enablePulse);
+}
+
+
+// The lcd on an MCP23017 backpack uses all 8 data pins, so it is initialized in 8 bit mode
+// (there are no nibbles, and each command is one enable pulse).
+void I2cCharDisplay::mcpBegin()
+{
+  uint8_t data[3];
+
+  delay(_timing.powerUpDelay);           // wait for lcd to power up
+
+  // byte mode, so that the register address toggles between the A and B registers
+  i2cWrite2(MCP23017_IOCON, MCP23017_SEQOP);
+
+  // both ports are outputs
+  data[0] = MCP23017_IODIRA;
+  data[1] = 0x00;
+  data[2] = 0x00;
+  i2cWriteN(data, 3);
+
+  // set all of the control outputs to 0, except the backlight bit if on
+  i2cWrite2(MCP23017_GPIOA, _lcdBacklightControl);
+  delay(_timing.setupDelay);
+
+  // put lcd in 8 bit mode (3 times, in case it was in the middle of something)
+  sendMcpByte(LCD_FUNCTIONSETCOMMAND | LCD_8BITMODE, LCD_COMMAND);
+  waitMicroseconds(_timing.resetDelay);  // wait min 4.1ms
+  sendMcpByte(LCD_FUNCTIONSETCOMMAND | LCD_8BITMODE, LCD_COMMAND);
+  waitMicroseconds(_timing.resetDelay);  // wait min 4.1ms
+  sendMcpByte(LCD_FUNCTIONSETCOMMAND | LCD_8BITMODE, LCD_COMMAND);
+  waitMicroseconds(_timing.resetDelay);  // wait min 4.1ms
+
+  // send the function set command
+  _lcdFunctionSetCommand = LCD_8BITMODE | LCD_1LINES | LCD_5x8DOTS;
+  if (_rows > 1)
+  {
+    _lcdFunctionSetCommand |= LCD_2LINES;
+  }
+  sendCommand(LCD_FUNCTIONSETCOMMAND | _lcdFunctionSetCommand);
+
+  // send the display command
+  // display on, no cursor and no blinking
+  _lcdDisplayControlCommand = LCD_DISPLAYON | LCD_CURSOROFF | LCD_CURSORBLINKOFF;
+  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+
+  // send the entry mode command
+  _lcdEntryModeCommand = LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF;
+  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+}
+
+
+// the lcd kept its power (checked by mcpConfigured()). In 8 bit mode a reset can't leave the lcd between
+// two nibbles, so just wait in case it was busy, and restore the same display settings that mcpBegin() uses.
+// The contents of the display are not cleared.
+void I2cCharDisplay::mcpWarmBegin()
+{
+  waitMicroseconds(_timing.resetDelay);  // in case the lcd was busy with a clear command
+
+  // send the function set command
+  _lcdFunctionSetCommand = LCD_8BITMODE | LCD_1LINES | LCD_5x8DOTS;
+  if (_rows > 1)
+  {
+    _lcdFunctionSetCommand |= LCD_2LINES;
+  }
+  sendCommand(LCD_FUNCTIONSETCOMMAND | _lcdFunctionSetCommand);
+
+  // send the display command
+  // display on, no cursor and no blinking
+  _lcdDisplayControlCommand = LCD_DISPLAYON | LCD_CURSOROFF | LCD_CURSORBLINKOFF;
+  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
+
+  // send the entry mode command
+  _lcdEntryModeCommand = LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF;
+  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+
   home();
 }
 
 
-void I2cCharDisplay::lcdBegin()
+// The MCP23017 powers up with IOCON = 0 and both ports as inputs. mcpBegin() sets byte mode and makes both
+// ports outputs (and the enable and read bits are always left low), so if it still reads back that way,
+// the backpack and lcd have kept their power since they were initialized.
+bool I2cCharDisplay::mcpConfigured()
+{
+  uint8_t data[2];
+
+  if (i2cWriteRead(MCP23017_IOCON, data, 1) != 1 || data[0] != MCP23017_SEQOP)
+  {
+    return false;
+  }
+  if (i2cWriteRead(MCP23017_IODIRA, data, 2) != 2 || data[0] != 0x00 || data[1] != 0x00)
+  {
+    return false;
+  }
+  if (i2cWriteRead(MCP23017_OLATA, data, 1) != 1 || (data[0] & (LCD_ENABLEON | LCD_READ)) != 0)
+  {
+    return false;
+  }
+
+  _lcdBacklightControl = data[0] & LCD_BACKLIGHTON;  // keep the backlight the way it was
+  return true;
+}
+
+
+// Send a byte to the lcd in one transmission. The register address toggles GPIOB, GPIOA, GPIOB, ...
+// so this sets the data and RS, then raises and lowers enable (the lcd reads the byte when enable goes low).
+void I2cCharDisplay::sendMcpByte(uint8_t value, uint8_t mode)
+{
+  uint8_t data[7];
+
+  data[0] = MCP23017_GPIOB;
+  data[1] = value;
+  data[2] = _lcdBacklightControl | mode;
+  data[3] = value;
+  data[4] = _lcdBacklightControl | mode | LCD_ENABLEON;
+  data[5] = value;
+  data[6] = _lcdBacklightControl | mode | LCD_ENABLEOFF;
+  i2cWriteN(data, 7);
+}
+
+
+// Read a data byte from the lcd. Port B is made an input (so that the lcd can drive the data pins)
+// while the read bit is set, and it is read while the enable bit is high.
+uint8_t I2cCharDisplay::mcpReadData()
+{
+  uint8_t control = _lcdBacklightControl | LCD_READ | LCD_DATA;
+  uint8_t value;
+
+  i2cWrite2(MCP23017_IODIRB, 0xFF);
+  i2cWrite2(MCP23017_GPIOA, control);
+  i2cWrite2(MCP23017_GPIOA, control | LCD_ENABLEON);
+  waitMicroseconds(_timing.enablePulse);
+  if (i2cWriteRead(MCP23017_GPIOB, &value, 1) != 1)
+  {
+    value = 0;
+  }
+  i2cWrite2(MCP23017_GPIOA, control | LCD_ENABLEOFF);
+  i2cWrite2(MCP23017_GPIOA, _lcdBacklightControl | LCD_WRITE);  // the lcd stops driving the data pins
+  i2cWrite2(MCP23017_IODIRB, 0x00);
+  return value;
+}
+
+
+// The signature is placed at the end of the first line in DDRAM, which is not shown on 16 and 20
+// column displays (unless the display is shifted that far).
+bool I2cCharDisplay::hasSignature()
+{
+  if (_displayType == OLED_TYPE)
+  {
+    return true;
+  }
+  return (_displayType == LCD_TYPE && _displayReadable && _rows <= 2);   // a 4 row lcd shows all of its DDRAM
+}
+
+
+// DDRAM address of the signature (see hasSignature())
+uint8_t I2cCharDisplay::signatureAddress()
+{
+  if (_rows > 2)          // 3/4 line mode, lines start at 0x00, 0x20, 0x40, 0x60
+  {
+    return 0x1E;
+  }
+  if (_rows == 2)         // 2 line mode, lines start at 0x00, 0x40
+  {
+    return 0x26;
+  }
+  return 0x4E;            // 1 line mode, the line is 0x00 - 0x4F
+}
+
+
+// write the warm start signature and move the cursor to home (all in one i2c transmission on the oled)
+void I2cCharDisplay::writeSignature()
+{
+  uint8_t data[8];
+
+  if (_referenceMode)               // one command or data byte at a time (see setReferenceMode())
+  {
+    sendCommand(LCD_SETDDRAMADDRCOMMAND | signatureAddress());
+    sendData(DISPLAY_SIGNATURE1);
+    sendData(DISPLAY_SIGNATURE2);
+    sendCommand(LCD_SETDDRAMADDRCOMMAND);
+  }
+  else if (_displayType != OLED_TYPE)
+  {
+    data[0] = DISPLAY_SIGNATURE1;
+    data[1] = DISPLAY_SIGNATURE2;
+    sendCommand(LCD_SETDDRAMADDRCOMMAND | signatureAddress());
+    sendDataBulk(data, 2);
+    sendCommand(LCD_SETDDRAMADDRCOMMAND);
+  }
+  else
+  {
+    data[0] = OLED_COMMANDMODE;
+    data[1] = LCD_SETDDRAMADDRCOMMAND | signatureAddress();
+    data[2] = OLED_DATACONTINUE;
+    data[3] = DISPLAY_SIGNATURE1;
+    data[4] = OLED_DATACONTINUE;
+    data[5] = DISPLAY_SIGNATURE2;
+    data[6] = OLED_COMMANDSTREAM;                 // last control byte, only commands follow
+    data[7] = LCD_SETDDRAMADDRCOMMAND;         // back to line 1 start (same place that clear() leaves the cursor)
+    i2cWriteN(data, 8);
+    waitMicroseconds(_timing.commandDelay);
+  }
+
+  _ddram[signatureAddress()]     = DISPLAY_SIGNATURE1;
+  _ddram[signatureAddress() + 1] = DISPLAY_SIGNATURE2;
+  _addressCounter = 0;
+  _addressIsCgram = false;
+}
+
+
+// Cheap check made by update() that an attached display has not been reset.
+// The lcd backpack outputs go high when it powers up (see lcdConfigured()), but the next write clears
+// them, so an lcd that can be read also has to still return its signature (see signatureKept()).
+// The oled loses the warm start signature when it powers up.
+// The MCP23017 powers up with IOCON = 0 (see mcpConfigured()), which writes to the lcd don't change.
+bool I2cCharDisplay::displayConfigured()
+{
+  uint8_t status;
+
+  switch (_displayType)
+  {
+  case LCD_TYPE:
+    if (i2cRead(&status, 1) != 1)
+    {
+      _displayAttached = false;
+      return false;
+    }
+    if ((status & (LCD_ENABLEON | LCD_READ)) != 0)
+    {
+      return false;
+    }
+    return (!_displayReadable || signatureKept());
+
+  case OLED_TYPE:
+    if (i2cWriteRead(OLED_COMMANDSTREAM, &status, 1) != 1)
+    {
+      _displayAttached = false;
+      return false;
+    }
+    if (status & 0x80)              // still busy, check again the next time
+    {
+      return true;
+    }
+    return signatureKept();
+
+  case LCD_MCP23017_TYPE:
+    if (i2cWriteRead(MCP23017_IOCON, &status, 1) != 1)
+    {
+      _displayAttached = false;
+      return false;
+    }
+    return (status == MCP23017_SEQOP);
+
+  default:
+
+    break;
+  }
+  return true;
+}
+
+
+// Read back the signature address (and compare it with the snapshot, in case something was printed over
+// the signature) and put the cursor back. A display that was reset has lost the signature. (A 4 row lcd
+// shows all of its DDRAM and has no signature, so what is printed there is compared.)
+// An lcd that was reset is back in 8 bit mode, where both nibbles of a read come from the high nibble, so
+// its address counter can't read back as the one after the 2 reads (whose nibbles differ).
+bool I2cCharDisplay::signatureKept()
+{
+  uint8_t data[3];
+  uint8_t address = signatureAddress();
+  uint8_t next    = (_lcdEntryModeCommand & LCD_DISPLAYLEFTTORIGHT) ? address + 1 : address - 1;  // reads move the address counter like writes
+  bool kept;
+
+  if (!readMemory(LCD_SETDDRAMADDRCOMMAND | address, data, 2))
+  {
+    _displayAttached = false;
+    return false;
+  }
+  kept = (data[0] == _ddram[address] && data[1] == _ddram[next]);
+  if (!kept && _displayType == OLED_TYPE)     // some oled modules return a dummy byte before the data
+  {
+    kept = (data[1] == _ddram[address] && data[2] == _ddram[next]);
+  }
+  if (kept && _displayType == LCD_TYPE)
+  {
+    kept = (lcdRead(LCD_COMMAND) == (uint8_t)(next + next - address));
+  }
+
+  if (_addressIsCgram)
+  {
+    sendFastCommand(LCD_SETCGRAMADDRCOMMAND | _addressCounter);
+  }
+  else
+  {
+    sendFastCommand(LCD_SETDDRAMADDRCOMMAND | _addressCounter);
+  }
+  return kept;
+}
+
+
+
+// returns the DDRAM address of position row,col (both start at 1)
+uint8_t I2cCharDisplay::ddramAddress(uint8_t row, uint8_t col)
+{
+  if (row > _rows)              // if user points to a row too large, change row to the bottom row
+  {
+    row = _rows;
+  }
+
+  if (_rows <= 2)               // if we have a 1 or 2 row display
+  {
+    uint8_t moveRowOffset2Rows[] =  { 0x00, 0x40};
+    return col-1 + moveRowOffset2Rows[row-1];
+  }
+  else                          // if we have a 3 or 4 line display
+  {
+    if (_displayType != OLED_TYPE)          // if using an LCD
+    {
+      uint8_t moveRowOffset4RowsLcd[] =  { 0x00, 0x40, 0x14, 0x54 };
+      return col-1 + moveRowOffset4RowsLcd[row-1];
+    }
+    else                                    // if using an OLED
+    {
+      uint8_t moveRowOffset4RowsOled[] = { 0x00, 0x20, 0x40, 0x60 };
+      return col-1 + moveRowOffset4RowsOled[row-1];
+    }
+  }
+}
+
+
+// returns the last DDRAM address of the row that address is in (a window that goes past it would
+// wrap to another row of the display)
+uint8_t I2cCharDisplay::lineEnd(uint8_t address)
+{
+  if (_rows > 2 && _displayType == OLED_TYPE)          // oled 3/4 line mode, rows are 0x20 addresses apart
+  {
+    return address | 0x1F;
+  }
+  if (_rows == 1)                                      // 1 line mode uses 0x00 - 0x4F
+  {
+    return 0x4F;
+  }
+  if (_rows > 2 && (address & 0x3F) < 0x14)            // lcd rows 1 and 2 (rows 3 and 4 are the rest of the DDRAM lines)
+  {
+    return (address & 0x40) | 0x13;
+  }
+  return (address & 0x40) | 0x27;                      // 2 line mode uses 0x00 - 0x27 and 0x40 - 0x67
+}
+
+
+// Send count data bytes to the display, using as few i2c transmissions as the Wire buffer allows.
+// On the oled, the data follows one control byte.
+// On the lcd, the 6 backpack writes that clock in each byte (2 nibbles, each with an enable pulse)
+// are sent in one transmission. The i2c bus is slow enough that each write lasts longer than the
+// enable pulse and the time the lcd needs to store the byte.
+void I2cCharDisplay::sendDataBulk(const uint8_t *data, uint8_t count)
+{
+  uint8_t buffer[DISPLAY_I2C_BUFFER_SIZE];
+  uint8_t length;
+
+  if (_referenceMode)               // one data byte at a time (see setReferenceMode())
+  {
+    while (count > 0)
+    {
+      sendData(*data++);
+      count--;
+    }
+    return;
+  }
+
+  while (count > 0)
+  {
+    length = 0;
+    switch (_displayType)
+    {
+    case LCD_TYPE:
+      while (count > 0 && length + 6 <= DISPLAY_I2C_BUFFER_SIZE)
+      {
+        uint8_t high = (*data & 0xf0) | _lcdBacklightControl | LCD_DATA;
+        uint8_t low  = ((*data << 4) & 0xf0) | _lcdBacklightControl | LCD_DATA;
+        buffer[length++] = high;
+        buffer[length++] = high | LCD_ENABLEON;
+        buffer[length++] = high | LCD_ENABLEOFF;
+        buffer[length++] = low;
+        buffer[length++] = low | LCD_ENABLEON;
+        buffer[length++] = low | LCD_ENABLEOFF;
+        data++;
+        count--;
+      }
+      break;
+
+    case OLED_TYPE:
+      buffer[length++] = OLED_DATAMODE;
+      while (count > 0 && length < DISPLAY_I2C_BUFFER_SIZE)
+      {
+        buffer[length++] = *data++;
+        count--;
+      }
+      break;
+
+    case LCD_MCP23017_TYPE:
+      // the register address toggles GPIOB (data), GPIOA (control), GPIOB, ... The first character and RS are
+      // set up before its enable pulse, then each character is: data, enable on, data, enable off
+      buffer[length++] = MCP23017_GPIOB;
+      buffer[length++] = *data;
+      buffer[length++] = _lcdBacklightControl | LCD_DATA;
+      while (count > 0 && length + 4 <= DISPLAY_I2C_BUFFER_SIZE)
+      {
+        buffer[length++] = *data;
+        buffer[length++] = _lcdBacklightControl | LCD_DATA | LCD_ENABLEON;
+        buffer[length++] = *data;
+        buffer[length++] = _lcdBacklightControl | LCD_DATA | LCD_ENABLEOFF;  // the lcd reads the character when enable goes low
+        data++;
+        count--;
+      }
+      break;
+
+    default:
+      return;
+    }
+    i2cWriteN(buffer, length);
+  }
+}
+
+
+// move the address counter of the snapshot one position, the same way the display does
+void I2cCharDisplay::advanceAddress(bool increment)
+{
+  if (_addressIsCgram)
+  {
+    _addressCounter = (_addressCounter + (increment ? 1 : -1)) & (DISPLAY_CGRAM_SIZE - 1);
+  }
+  else if (_rows > 2 && _displayType == OLED_TYPE)     // oled 3/4 line mode uses all of 0x00 - 0x7F
+  {
+    _addressCounter = (_addressCounter + (increment ? 1 : -1)) & (DISPLAY_DDRAM_SIZE - 1);
+  }
+  else if (_rows == 1)                                 // 1 line mode uses 0x00 - 0x4F
+  {
+    if (increment)
+      _addressCounter = (_addressCounter >= 0x4F) ? 0x00 : _addressCounter + 1;
+    else
+      _addressCounter = (_addressCounter == 0x00) ? 0x4F : _addressCounter - 1;
+  }
+  else                                                 // 2 line mode uses 0x00 - 0x27 and 0x40 - 0x67
+  {
+    if (increment)
+    {
+      if (_addressCounter == 0x27)
+        _addressCounter = 0x40;
+      else if (_addressCounter >= 0x67)
+        _addressCounter = 0x00;
+      else
+        _addressCounter++;
+    }
+    else
+    {
+      if (_addressCounter == 0x40)
+        _addressCounter = 0x27;
+      else if (_addressCounter == 0x00)
+        _addressCounter = 0x67;
+      else
+        _addressCounter--;
+    }
+  }
+}
+
+
+// returns true if the display has DDRAM at address (the same addresses that advanceAddress() moves through)
+bool I2cCharDisplay::ddramAddressUsed(uint8_t address)
+{
+  if (address >= DISPLAY_DDRAM_SIZE)
+  {
+    return false;
+  }
+  if (_rows > 2 && _displayType == OLED_TYPE)          // oled 3/4 line mode uses all of 0x00 - 0x7F
+  {
+    return true;
+  }
+  if (_rows == 1)                                      // 1 line mode uses 0x00 - 0x4F
+  {
+    return (address <= 0x4F);
+  }
+  return ((address & 0x3F) <= 0x27);                   // 2 line mode uses 0x00 - 0x27 and 0x40 - 0x67
+}
+
+
+// After a warm start the display still shows what was written before the microcontroller was reset, so read
+// it back into the snapshot. Otherwise sendCells() would skip the cells that are blank in the snapshot but
+// not on the display, and restore() would wipe the display.
+// Reads are slow (an lcd character takes 9 i2c transmissions), so only the first DISPLAY_WARM_COLUMNS of each
+// row are read, and the rest of the row (which a 16 or 20 column display doesn't show) is cleared instead.
+// The custom characters are not read back, create them again after begin() (as after a cold start).
+// If the display can't be read, it is cleared.
+void I2cCharDisplay::readSnapshot()
+{
+  uint8_t data[DISPLAY_WARM_COLUMNS + 1];
+  uint8_t offset;
+
+  if (!_displayReadable)
+  {
+    clear();
+    return;
+  }
+
+  offset = readOffset();
+  for (uint8_t row = 1; row <= _rows && row <= DISPLAY_MAX_ROWS; ++row)
+  {
+    uint8_t address = ddramAddress(row, 1) & 0x7F;
+    uint8_t length  = lineEnd(address) - address + 1;
+    uint8_t count   = (length < DISPLAY_WARM_COLUMNS) ? length : DISPLAY_WARM_COLUMNS;
+
+    if (readMemory(LCD_SETDDRAMADDRCOMMAND | address, data, count))
+    {
+      memcpy(&_ddram[address], &data[offset], count);
+    }
+
+    address += count;
+    length  -= count;
+    if (length > 0)
+    {
+      memset(data, ' ', sizeof(data));
+      sendFastCommand(LCD_SETDDRAMADDRCOMMAND | address);
+      while (length > 0)
+      {
+        count = (length < sizeof(data)) ? length : sizeof(data);
+        sendDataBulk(data, count);
+        memset(&_ddram[address], ' ', count);
+        address += count;
+        length  -= count;
+      }
+    }
+  }
+
+  if (hasSignature())               // the signature was cleared with the rest of its row
+  {
+    writeSignature();
+  }
+  else
+  {
+    sendFastCommand(LCD_SETDDRAMADDRCOMMAND);   // back home, where lcdWarmBegin() left the cursor
+    _addressCounter = 0;
+    _addressIsCgram = false;
+  }
+}
+
+
+// Some oled modules return a dummy byte before the data that they read. Read the signature (or what was
+// printed over it, which the snapshot has) to find out. Returns 1 if there is a dummy byte, 0 if not.
+// (The entry mode has to be left to right.)
+uint8_t I2cCharDisplay::readOffset()
+{
+  uint8_t data[3];
+  uint8_t address = signatureAddress();
+
+  if (_displayType != OLED_TYPE || !readMemory(LCD_SETDDRAMADDRCOMMAND | address, data, 2))
+  {
+    return 0;
+  }
+  return (data[0] == _ddram[address] && data[1] == _ddram[address + 1]) ? 0 : 1;
+}
+
+
+// record a data byte that was just sent to the display, and move the address counter (and display
+// shift) the same way that the display does with the current entry mode
+void I2cCharDisplay::trackData(uint8_t value)
+{
+  bool increment = (_lcdEntryModeCommand & LCD_DISPLAYLEFTTORIGHT);
+
+  if (_addressIsCgram)
+  {
+    _cgram[_addressCounter] = value;
+    _cgramUsed |= 1 << (_addressCounter >> 3);
+  }
+  else
+  {
+    _ddram[_addressCounter] = value;
+    if (_lcdEntryModeCommand & LCD_DISPLAYSHIFTON)
+    {
+      _displayShiftCount += increment ? -1 : 1;
+      if (_displayShiftCount <= -40 || _displayShiftCount >= 40)
+      {
+        _displayShiftCount = 0;
+      }
+    }
+  }
+  advanceAddress(increment);
+}
+
+
+// Send DDRAM addresses start to end-1 of the snapshot to the (just cleared) display.
+// Blank runs are skipped with a set address command, unless they are too short to be worth it.
+void I2cCharDisplay::replayDdram(uint8_t start, uint8_t end)
+{
+  uint8_t address = start;
+
+  while (address < end)
+  {
+    if (_ddram[address] == ' ')
+    {
+      address++;
+      continue;
+    }
+
+    // find the end of this run, including blank gaps of 2 or less
+    uint8_t runEnd = address + 1;
+    uint8_t blanks = 0;
+    while (runEnd < end && blanks <= 2)
+    {
+      blanks = (_ddram[runEnd] == ' ') ? blanks + 1 : 0;
+      runEnd++;
+    }
+    runEnd -= blanks;
+
+    sendCommand(LCD_SETDDRAMADDRCOMMAND | address);
+    sendDataBulk(&_ddram[address], runEnd - address);
+    address = runEnd;
+  }
+}
+
+
+// set the DDRAM snapshot to what clear() leaves on the display
+void I2cCharDisplay::clearSnapshot()
+{
+  memset(_ddram, ' ', DISPLAY_DDRAM_SIZE);
+  _addressCounter    = 0;
+  _addressIsCgram    = false;
+  _displayShiftCount = 0;
+}
+
+
+// Write count characters starting at a DDRAM address (in the same line), but only send the
+// characters that are different from the snapshot, then put the cursor back.
+void I2cCharDisplay::writeCells(uint8_t address, const uint8_t *data, uint8_t count)
+{
+  sendCells(address, data, count);
+  finishCells();
+}
+
+
+// Send the characters that are different from the snapshot (starting at a DDRAM address, in the same line).
+// Each run of changed characters costs one set address command and one bulk data transfer (the commands
+// don't wait the commandDelay, so marquees, fields and layers don't block update() on an oled).
+// The first run sets the entry mode to left to right (if needed), and finishCells() puts the entry
+// mode and cursor back, so several calls can share that cost.
+// Characters past the end of the row are dropped (the display's address counter would jump to another
+// line, e.g. a layer that hangs over the right edge of the display).
+void I2cCharDisplay::sendCells(uint8_t address, const uint8_t *data, uint8_t count)
+{
+  uint8_t i = 0;
+
+  if (!ddramAddressUsed(address))
+  {
+    return;
+  }
+  if (count > lineEnd(address) - address + 1)
+  {
+    count = lineEnd(address) - address + 1;
+  }
+
+  while (i < count)
+  {
+    if (_ddram[(address + i) & 0x7F] == data[i] && !_referenceMode)
+    {
+      i++;
+      continue;
+    }
+
+    // find the end of this run of changes, including unchanged gaps of 2 or less
+    uint8_t runEnd = i + 1;
+    uint8_t same   = 0;
+    while (runEnd < count && same <= 2)
+    {
+      same = (_ddram[(address + runEnd) & 0x7F] == data[runEnd] && !_referenceMode) ? same + 1 : 0;
+      runEnd++;
+    }
+    runEnd -= same;
+
+    if (!_cellsSent)
+    {
+      _cellsSent = true;
+      if (_lcdEntryModeCommand != (LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF))    // the bulk writes need left to right, no shift
+      {
+        sendFastCommand(LCD_ENTRYMODECOMMAND | LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF);
+      }
+    }
+    sendFastCommand(LCD_SETDDRAMADDRCOMMAND | ((address + i) & 0x7F));
+    sendDataBulk(&data[i], runEnd - i);
+    memcpy(&_ddram[(address + i) & 0x7F], &data[i], runEnd - i);
+    i = runEnd;
+  }
+}
+
+
+// put the entry mode and the cursor back after sendCells() (if it sent anything)
+void I2cCharDisplay::finishCells()
+{
+  if (!_cellsSent)
+  {
+    return;
+  }
+  _cellsSent = false;
+
+  if (_lcdEntryModeCommand != (LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF))
+  {
+    sendFastCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+  }
+  if (_addressIsCgram)
+  {
+    sendFastCommand(LCD_SETCGRAMADDRCOMMAND | _addressCounter);
+  }
+  else
+  {
+    sendFastCommand(LCD_SETDDRAMADDRCOMMAND | _addressCounter);
+  }
+}
+
+
+#if DISPLAY_MARQUEES > 0
+// write the window of a marquee at its current position
+void I2cCharDisplay::drawMarquee(uint8_t marquee)
+{
+  Marquee &m = _marquees[marquee];
+  uint8_t window[DISPLAY_MARQUEE_MAX_WIDTH];
+  uint16_t index = m.position;
+  const char *next = m.text;
+
+  if (!m.utf8)
+  {
+    next += (index < m.length) ? index : m.length;
+  }
+  else
+  {
+    for (uint16_t i = 0; i < index && i < m.length; ++i)    // skip to the character at the left edge of the window
+    {
+      marqueeCharacter(next, true);
+    }
+  }
+  for (uint8_t i = 0; i < m.width; ++i)
+  {
+    window[i] = (index < m.length) ? marqueeCharacter(next, m.utf8) : ' ';
+    if (++index >= m.length + m.width)
+    {
+      index = 0;
+      next  = m.text;
+    }
+  }
+  writeCells(m.address, window, m.width);
+}
+
+
+// returns the display character code of the character at text (decoding UTF-8 with the charset if utf8 is
+// true), and moves text past it
+uint8_t I2cCharDisplay::marqueeCharacter(const char *&text, bool utf8)
+{
+  uint32_t codepoint = 0;
+  uint8_t remaining  = 0;
+  int16_t character;
+
+  if (!utf8)
+  {
+    return *text++;
+  }
+  do
+  {
+    character = decodeCharacter(*text++, codepoint, remaining);
+  } while (character < 0 && *text != 0);
+  return (character < 0) ? pgm_read_byte(&charsets[_charset].replacement) : character;   // the text ended in the middle of a character
+}
+#endif
+
+
+// Send an oled command and its value that need the extended command set (RE=1, SD=1),
+// e.g. set contrast (brightness) or set fade. All 6 commands go in one i2c transmission,
+// each one with its own control byte, and the last control byte starts a command stream.
+// There is no commandDelay wait after it (the TIMING_US2066_SAFE 10ms would make every step of
+// fadeBrightness() block update()), the i2c transfer of the next command gives the oled the time it needs.
+void I2cCharDisplay::sendOledExtendedCommand(uint8_t command, uint8_t value)
+{
+  uint8_t data[12];
+
+  if (_referenceMode)               // one command at a time (see setReferenceMode())
+  {
+    sendCommand(0x2A);
+    sendCommand(0x79);
+    sendCommand(command);
+    sendCommand(value);
+    sendCommand(0x78);
+    sendCommand(0x28);
+    return;
+  }
+
+  data[0]  = OLED_COMMANDMODE;
+  data[1]  = 0x2A;          // set RE=1
+  data[2]  = OLED_COMMANDMODE;
+  data[3]  = 0x79;          // set SD=1
+  data[4]  = OLED_COMMANDMODE;
+  data[5]  = command;
+  data[6]  = OLED_COMMANDMODE;
+  data[7]  = value;
+  data[8]  = OLED_COMMANDMODE;
+  data[9]  = 0x78;          // set SD=0
+  data[10] = OLED_COMMANDSTREAM;
+  data[11] = 0x28;          // set RE=0
+  i2cWriteN(data, 12);
+}
+
+
+// The brightness step made by update() while a fade is running. The time since the start of the fade
+// is scaled to 0-256, bent by the curve, and used to pick the brightness between the start and end
+// brightness. A step is only sent if the brightness changed.
+void I2cCharDisplay::stepBrightnessFade()
+{
+  unsigned long now = millis();
+  unsigned long elapsed = now - _fadeStartTime;
+  uint16_t t;
+  uint16_t eased;
+  uint8_t brightness;
+
+  if (elapsed >= _fadeTime)
+  {
+    brightness   = _fadeEndBrightness;
+    _fadeRunning = false;
+  }
+  else
+  {
+    if (now - _fadeStepTime < OLED_FADESTEPTIME && now != _fadeStartTime)
+    {
+      return;
+    }
+    _fadeStepTime = now;
+
+    t = (uint16_t)((elapsed * 256) / _fadeTime);     // 0 - 255
+    switch (_fadeCurve)
+    {
+    case FADE_EASEIN:
+      eased = (t * t) >> 8;
+      break;
+
+    case FADE_EASEOUT:
+      eased = 256 - (((uint32_t)(256 - t) * (256 - t)) >> 8);
+      break;
+
+    case FADE_EASEINOUT:
+      if (t < 128)
+        eased = (t * t) >> 7;
+      else
+        eased = 256 - (((256 - t) * (256 - t)) >> 7);
+      break;
+
+    default:
+      eased = t;
+      break;
+    }
+    brightness = _fadeStartBrightness + (((int16_t)_fadeEndBrightness - _fadeStartBrightness) * (int32_t)eased) / 256;
+  }
+
+  if (brightness != _oledBrightness)
+  {
+    sendOledExtendedCommand(OLED_SETBRIGHTNESSCOMMAND, brightness);
+    _oledBrightness = brightness;
+  }
+}
+
+
+// Send count custom characters, starting at first, from the CGRAM snapshot to the display.
+// The entry mode is set to left to right (so the address counter goes up) while sending,
+// then the entry mode and the cursor are put back.
+void I2cCharDisplay::sendCharacters(uint8_t first, uint8_t count)
+{
+  uint8_t entryModeCommand = _lcdEntryModeCommand;
+
+  if (count == 0)
+  {
+    return;
+  }
+
+  if (entryModeCommand != (LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF))
+  {
+    sendFastCommand(LCD_ENTRYMODECOMMAND | LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF);
+  }
+  sendFastCommand(LCD_SETCGRAMADDRCOMMAND | (first << 3));
+  sendDataBulk(&_cgram[first << 3], count << 3);
+  _cgramUsed |= ((1 << count) - 1) << first;
+
+  if (entryModeCommand != (LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF))
+  {
+    sendFastCommand(LCD_ENTRYMODECOMMAND | entryModeCommand);
+  }
+  if (_addressIsCgram)
+  {
+    sendFastCommand(LCD_SETCGRAMADDRCOMMAND | _addressCounter);
+  }
+  else
+  {
+    sendFastCommand(LCD_SETDDRAMADDRCOMMAND | _addressCounter);
+  }
+}
+
+
+// Decode UTF-8 text one byte at a time. The decoder state (codepoint and remaining) belongs to the caller,
+// so that the display and each layer can be in the middle of their own multi-byte character.
+// returns the display character code when a character is complete, or -1 if more bytes are needed.
+// Bytes that are not valid UTF-8 are shown as the replacement character.
+int16_t I2cCharDisplay::decodeCharacter(uint8_t value, uint32_t &codepoint, uint8_t &remaining)
+{
+  if (value < 0x80)                                 // ASCII
+  {
+    remaining = 0;
+    return translateCodepoint(value);
+  }
+  if ((value & 0xC0) == 0x80)                       // continuation byte
+  {
+    if (remaining == 0)
+    {
+      return pgm_read_byte(&charsets[_charset].replacement);
+    }
+    codepoint = (codepoint << 6) | (value & 0x3F);
+    if (--remaining > 0)
+    {
+      return -1;
+    }
+    return translateCodepoint(codepoint);
+  }
+
+  // first byte of a UTF-8 character (if the last character was not finished, it is dropped)
+  if ((value & 0xE0) == 0xC0)
+  {
+    codepoint = value & 0x1F;
+    remaining = 1;
+  }
+  else if ((value & 0xF0) == 0xE0)
+  {
+    codepoint = value & 0x0F;
+    remaining = 2;
+  }
+  else if ((value & 0xF8) == 0xF0)
+  {
+    codepoint = value & 0x07;
+    remaining = 3;
+  }
+  else
+  {
+    remaining = 0;
+    return pgm_read_byte(&charsets[_charset].replacement);
+  }
+  return -1;
+}
+
+
+// returns the display character code for a unicode codepoint, using the charset
+uint8_t I2cCharDisplay::translateCodepoint(uint32_t codepoint)
+{
+  const Charset *charset       = &charsets[_charset];
+  const uint8_t *ascii         = (const uint8_t *)pgm_read_ptr(&charset->ascii);
+  const CharsetRange *table    = (const CharsetRange *)pgm_read_ptr(&charset->table);
+  uint8_t replacement          = pgm_read_byte(&charset->replacement);
+
+  // most text is ASCII that the ROM shows as it is, which only needs one bit from the bitmap
+  if (codepoint < 0x80 && !(pgm_read_byte(&ascii[codepoint >> 3]) & (1 << (codepoint & 7))))
+  {
+    return codepoint;
+  }
+
+#if DISPLAY_MAPPEDCHARACTERS > 0
+  for (uint8_t i = 0; i < DISPLAY_MAPPEDCHARACTERS && _mappedCodepoints[i] != 0; ++i)
+  {
+    if (_mappedCodepoints[i] == codepoint)
+    {
+      return _mappedCharacters[i];
+    }
+  }
+#endif
+
+  if (codepoint > 0xFFFF)
+  {
+    return replacement;
+  }
+
+  // binary search for the last range that starts at or below the codepoint
+  uint8_t low  = 0;
+  uint8_t high = pgm_read_byte(&charset->tableSize);
+  while (low < high)
+  {
+    uint8_t middle = (low + high) / 2;
+    if (pgm_read_word(&table[middle].codepoint) <= codepoint)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+  if (low > 0)
+  {
+    const CharsetRange *range = &table[low - 1];
+    uint16_t offset = codepoint - pgm_read_word(&range->codepoint);
+    if (offset < pgm_read_byte(&range->count))
+    {
+      return pgm_read_byte(&range->character) + offset;
+    }
+  }
+  return replacement;
+}
+
+
+#if DISPLAY_LAYERS > 0
+// mark an area of the display that compose() needs to redraw (positions start at 1)
+void I2cCharDisplay::damage(uint8_t row, uint8_t col, uint8_t rows, uint8_t cols)
+{
+  if (row < 1)                      // positions start at 1
+  {
+    row = 1;
+  }
+  if (col < 1)
+  {
+    col = 1;
+  }
+  uint8_t right = col + cols - 1;
+
+  if (right > DISPLAY_MAX_COLUMNS)
+  {
+    right = DISPLAY_MAX_COLUMNS;
+  }
+  for (uint8_t i = row; i < row + rows && i <= _rows && i <= DISPLAY_MAX_ROWS; ++i)
+  {
+    if (col < _damageLeft[i - 1])
+    {
+      _damageLeft[i - 1] = col;
+    }
+    if (right > _damageRight[i - 1])
+    {
+      _damageRight[i - 1] = right;
+    }
+  }
+}
+
+
+// the character of the top visible layer at row,col of the display (blank if no layer covers it)
+uint8_t I2cCharDisplay::layerCell(uint8_t row, uint8_t col)
+{
+  I2cCharLayer *top = NULL;
+
+  for (uint8_t i = 0; i < DISPLAY_LAYERS; ++i)
+  {
+    I2cCharLayer *layer = _layers[i];
+    if (layer != NULL && layer->_visible &&
+        row >= layer->_row && row < layer->_row + layer->_rows &&
+        col >= layer->_col && col < layer->_col + layer->_cols &&
+        (top == NULL || layer->_z >= top->_z))
+    {
+      top = layer;
+    }
+  }
+  if (top == NULL)
+  {
+    return ' ';
+  }
+  return top->_buffer[(row - top->_row) * top->_cols + (col - top->_col)];
+}
+#endif
+
+
+
+// I2cCharLayer functions
+
+I2cCharLayer::I2cCharLayer(uint8_t *buffer, uint8_t rows, uint8_t cols)
+{
+  _buffer      = buffer;
+  _rows        = rows;
+  _cols        = cols;
+  _row         = 1;
+  _col         = 1;
+  _z           = 0;
+  _visible     = true;
+  _display     = NULL;
+  clear();
+}
+
+
+void I2cCharLayer::setPosition(uint8_t row, uint8_t col)
+{
+  damageArea();                  // the old area
+  _row = (row < 1) ? 1 : row;    // positions start at 1
+  _col = (col < 1) ? 1 : col;
+  damageArea();                  // and the new area
+}
+
+
+void I2cCharLayer::setZ(uint8_t z)
+{
+  _z = z;
+  damageArea();
+}
+
+
+void I2cCharLayer::show()
+{
+  _visible = true;
+  damageArea();
+}
+
+
+void I2cCharLayer::hide()
+{
+  damageArea();
+  _visible = false;
+}
+
+
+bool I2cCharLayer::visible()
+{
+  return _visible;
+}
+
+
+void I2cCharLayer::clear()
+{
+  memset(_buffer, ' ', _rows * _cols);
+  _cursorRow   = 0;
+  _cursorCol   = 0;
+  _utf8Remaining = 0;
+  _dirtyTop    = 0;
+  _dirtyBottom = _rows - 1;
+  _dirtyLeft   = 0;
+  _dirtyRight  = _cols - 1;
+}
+
+
+void I2cCharLayer::cursorMove(uint8_t row, uint8_t col)
+{
+  _cursorRow = row - 1;
+  _cursorCol = col - 1;
+}
+
+
+void I2cCharLayer::setCell(uint8_t row, uint8_t col, uint8_t character)
+{
+  row--;
+  col--;
+  if (row < _rows && col < _cols && _buffer[row * _cols + col] != character)
+  {
+    _buffer[row * _cols + col] = character;
+    markDirty(row, col);
+  }
+}
+
+
+// write a character at the layer cursor (characters past the end of a row, or below the last row, are dropped),
+// '\n' moves the cursor to the start of the next row and '\r' is ignored (so println() works)
+size_t I2cCharLayer::write(uint8_t value)
+{
+  if (value == '\n')
+  {
+    if (_cursorRow < _rows)        // stop below the last row (so that the cursor doesn't wrap around to row 1)
+    {
+      _cursorRow++;
+    }
+    _cursorCol = 0;
+    return 1;
+  }
+  if (value == '\r')
+  {
+    return 1;
+  }
+  if (_display != NULL && _display->_charset != CHARSET_RAW)    // use the charset of the display
+  {
+    int16_t character = _display->decodeCharacter(value, _utf8Codepoint, _utf8Remaining);
+    if (character < 0)            // in the middle of a UTF-8 character
+    {
+      return 1;
+    }
+    value = character;
+  }
+  if (_cursorCol < _cols)          // stop past the end of the row (so that the cursor doesn't wrap around to column 1)
+  {
+    setCell(_cursorRow + 1, _cursorCol + 1, value);
+    _cursorCol++;
+  }
+  return 1;
+}
+
+
+// note a changed cell (positions start at 0)
+void I2cCharLayer::markDirty(uint8_t row, uint8_t col)
+{
+  if (_dirtyTop > _dirtyBottom)     // nothing was dirty
+  {
+    _dirtyTop    = row;
+    _dirtyBottom = row;
+    _dirtyLeft   = col;
+    _dirtyRight  = col;
+    return;
+  }
+  if (row < _dirtyTop)
+    _dirtyTop = row;
+  if (row > _dirtyBottom)
+    _dirtyBottom = row;
+  if (col < _dirtyLeft)
+    _dirtyLeft = col;
+  if (col > _dirtyRight)
+    _dirtyRight = col;
+}
+
+
+// tell the display that the whole area of the layer needs to be redrawn (e.g. it moved, or was hidden)
+void I2cCharLayer::damageArea()
+{
+#if DISPLAY_LAYERS > 0
+  if (_display != NULL)
+  {
+    _display->damage(_row, _col, _rows, _cols);
+  }
+#endif
+}
+
+
+// When the current frame has been shown long enough, play the records of the next frame.
+// All of the characters of a frame share one cursor restore at the end of the frame.
+void I2cCharDisplay::stepAnimation()
+{
+  uint8_t cells[DISPLAY_MAX_COLUMNS];
+  uint8_t row, col, first, count;
+  bool changed;
+
+  if ((millis() - _animationFrameStart) < _animationFrameTime)
+  {
+    return;
+  }
+
+  for (;;)
+  {
+    switch (pgm_read_byte(_animationNext++))
+    {
+    case ANIMATION_GLYPHS:
+      first = pgm_read_byte(_animationNext++) & 0x7;
+      count = pgm_read_byte(_animationNext++);
+      if (count > 8 - first)
+      {
+        count = 8 - first;
+      }
+      changed = ((_cgramUsed >> first) & ((1 << count) - 1)) != ((1 << count) - 1);
+      for (uint8_t i = 0; i < (count << 3); ++i)
+      {
+        uint8_t pixels = pgm_read_byte(_animationNext++);
+        changed |= (_cgram[(first << 3) + i] != pixels);
+        _cgram[(first << 3) + i] = pixels;
+      }
+      if (changed)                  // the first frame has all of its glyphs, don't send them again when it repeats
+      {
+        finishCells();
+        sendCharacters(first, count);
+      }
+      break;
+
+    case ANIMATION_CELLS:
+      row   = pgm_read_byte(_animationNext++);
+      col   = pgm_read_byte(_animationNext++);
+      count = pgm_read_byte(_animationNext++);
+      for (uint8_t i = 0; i < count; ++i)
+      {
+        uint8_t character = pgm_read_byte(_animationNext++);
+        if (i < DISPLAY_MAX_COLUMNS)
+        {
+          cells[i] = character;
+        }
+      }
+      if (count > DISPLAY_MAX_COLUMNS)
+      {
+        count = DISPLAY_MAX_COLUMNS;
+      }
+      sendCells(ddramAddress(row, col) & 0x7F, cells, count);
+      break;
+
+    case ANIMATION_FRAME:
+      _animationFrameTime  = pgm_read_byte(_animationNext) | (pgm_read_byte(_animationNext + 1) << 8);
+      _animationNext      += 2;
+      _animationFrameStart = millis();
+      finishCells();
+      return;
+
+    default:                        // ANIMATION_END
+      finishCells();
+      if (_animationRepeat)
+      {
+        _animationNext      = _animation + ANIMATION_HEADERSIZE;
+        _animationFrameTime = 0;
+      }
+      else
+      {
+        _animation = NULL;
+      }
+      return;
+    }
+  }
+}
+
+
+#if DISPLAY_QUEUE_SIZE > 0
+// Add a record to the isr queue. Only the interrupt handler changes _queueHead, so the record is
+// written first and then _queueHead moves to make it visible to update().
+bool I2cCharDisplay::queueRecord(uint8_t type, uint8_t a, uint8_t b, int32_t value)
+{
+  uint8_t head = _queueHead;
+  uint8_t next = (head + 1) & (DISPLAY_QUEUE_SIZE - 1);
+
+  if (next == _queueTail)           // full, count it instead of waiting for update()
+  {
+    _queueOverflows = _queueOverflows + 1;
+    return false;
+  }
+  _queue[head].type  = type;
+  _queue[head].a     = a;
+  _queue[head].b     = b;
+  _queue[head].value = value;
+  QUEUE_BARRIER();
+  _queueHead = next;
+  return true;
+}
+
+
+// Send the records of the isr queue to the display. Only update() changes _queueTail, so each record
+// is copied first and then _queueTail moves to give it back to the interrupt handler.
+// Cells are sent (if they changed) as they are read, fields are drawn once with their last value.
+void I2cCharDisplay::drainQueue()
+{
+  uint8_t tail = _queueTail;
+
+  while (tail != _queueHead)
+  {
+    QUEUE_BARRIER();
+    QueueRecord record = _queue[tail];
+    QUEUE_BARRIER();
+    tail = (tail + 1) & (DISPLAY_QUEUE_SIZE - 1);
+    _queueTail = tail;
+
+    switch (record.type)
+    {
+    case QUEUE_CELL:
+      if (record.a >= 1 && record.a <= _rows && record.b >= 1 && record.b <= DISPLAY_MAX_COLUMNS)
+      {
+        uint8_t character = (uint8_t)record.value;
+        sendCells(ddramAddress(record.a, record.b) & 0x7F, &character, 1);
+      }
+      break;
+
+#if DISPLAY_FIELDS > 0
+    case QUEUE_FIELD:
+      _fields[record.a].value = record.value;
+      _fieldsChanged |= (1 << record.a);
+      break;
+
+    default:                        // QUEUE_FLUSH
+      _fieldsFlush = true;
+      break;
+#endif
+    }
+  }
+
+#if DISPLAY_FIELDS > 0
+  if (_fieldsChanged != 0 && (_fieldsFlush || (millis() - _fieldDrawTime) >= _fieldInterval))
+  {
+    for (uint8_t i = 0; i < DISPLAY_FIELDS; ++i)
+    {
+      if (_fieldsChanged & (1 << i))
+      {
+        drawField(i);
+      }
+    }
+    _fieldsChanged = 0;
+    _fieldDrawTime = millis();
+  }
+  _fieldsFlush = false;
+#endif
+  finishCells();
+}
+#endif
+
+
+#if DISPLAY_FIELDS > 0
+
+
+void I2cCharDisplay::drawField(uint8_t field)
+{
+  Field &f = _fields[field];
+  uint8_t text[DISPLAY_FIELD_MAX_WIDTH];
+  uint32_t magnitude = (f.value < 0) ? (0 - (uint32_t)f.value) : (uint32_t)f.value;
+  uint8_t i = f.width;
+
+  if (f.width == 0)                 // not defined
+  {
+    return;
+  }
+
+  do
+  {
+    text[--i] = '0' + (magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0 && i > 0);
+
+  bool fits = (magnitude == 0);
+  if (f.value < 0)
+  {
+    if (i == 0)
+    {
+      fits = false;
+    }
+    else
+    {
+      text[--i] = '-';
+    }
+  }
+
+  if (!fits)
+  {
+    memset(text, '*', f.width);
+  }
+  else
+  {
+    memset(text, ' ', i);
+  }
+  sendCells(f.address, text, f.width);
+}
+#endif
+
+
+// delayMicroseconds() is only accurate up to about 16ms on some boards, so wait for the whole ms with delay()
+void I2cCharDisplay::waitMicroseconds(uint16_t microseconds)
+{
+  if (microseconds >= 1000)
+  {
+    delay(microseconds / 1000);
+    microseconds %= 1000;
+  }
+  if (microseconds != 0)
+  {
+    delayMicroseconds(microseconds);
+  }
+}
+
+
+// Read a data byte (mode = LCD_DATA), or the busy flag and address counter (mode = LCD_COMMAND), from the lcd.
+// The data pins of the backpack are written high (so that the lcd can drive them) with the read bit set, and
+// each nibble is read while the enable bit is high.
+// The read bit is cleared again at the end (lcdConfigured() expects it to be low).
+uint8_t I2cCharDisplay::lcdRead(uint8_t mode)
 {
+  uint8_t control = 0xF0 | _lcdBacklightControl | LCD_READ | mode;
+  uint8_t value = 0;
   uint8_t data;
 
+  for (uint8_t i = 0; i < 2; ++i)
+  {
+    i2cWrite1(control);
+    i2cWrite1(control | LCD_ENABLEON);
+    waitMicroseconds(_timing.enablePulse);
+    if (i2cRead(&data, 1) != 1)
+    {
+      data = 0;
+    }
+    i2cWrite1(control | LCD_ENABLEOFF);
+    waitMicroseconds(_timing.enablePulse);
+    value = (value << 4) | (data >> 4);
+  }
+  i2cWrite1(_lcdBacklightControl | LCD_WRITE);
+  return value;
+}
 
-/*
- * // enable i2c if it is not already
- * if (!Wire.isEnabled())
- * {
- *  Wire.begin();
- * }
- */
-// initialize the lcd
-  delay(100);           // wait for lcd to power up
 
-  // set all of the outputs on the PCA8574 chip to 0, except the backlight bit if on
-  data = _lcdBacklightControl;
-  i2cWrite1((int)(data));
-  delay(1000);
+// Read count bytes from DDRAM or CGRAM, starting at the address set by command. Some oled modules return
+// a dummy byte before the data, so the oled reads count + 1 bytes (see readOffset()), data must hold them.
+// The set address command doesn't wait commandDelay (the i2c transfer of the read gives the display the
+// time it needs), so a warm start and verifyDisplay() don't wait 10ms per read with TIMING_US2066_SAFE.
+// Returns false if the display can't be read (see lcdReadable()) or didn't answer.
+bool I2cCharDisplay::readMemory(uint8_t command, uint8_t *data, uint8_t count)
+{
+  if (!_displayReadable)
+  {
+    return false;
+  }
+  sendFastCommand(command);
+  if (_displayType == OLED_TYPE)
+  {
+    return (i2cWriteRead(OLED_DATAMODE, data, count + 1) == count + 1);
+  }
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    data[i] = (_displayType == LCD_MCP23017_TYPE) ? mcpReadData() : lcdRead(LCD_DATA);
+  }
+  return _displayAttached;
+}
 
-  // put lcd in 4 bit mode
-  data = 0x30 | _lcdBacklightControl;
-  i2cWrite1((int)(data));
-  // set the enable bit and write again
-  i2cWrite1((int)(data | LCD_ENABLEON));
-  delayMicroseconds(1);                 // hold enable high for 1us
-  // clear the enable bit and write again
-  i2cWrite1((int)(data | LCD_ENABLEOFF));
-  delayMicroseconds(1);
-  delayMicroseconds(4300);  // wait min 4.1ms
 
-  // put lcd in 4 bit mode again
-  data = 0x30 | _lcdBacklightControl;
-  i2cWrite1((int)(data));
-  // set the enable bit and write again
-  i2cWrite1((int)(data | LCD_ENABLEON));
-  delayMicroseconds(1);                 // hold enable high for 1us
-  // clear the enable bit and write again
-  i2cWrite1((int)(data | LCD_ENABLEOFF));
-  delayMicroseconds(1);
-  delayMicroseconds(4300);   // wait min 4.1ms
+// An lcd backpack that doesn't connect the read/write pin of the lcd reads back its own outputs (all high)
+// instead of what the lcd drives, so set the address counter and read it back with the busy flag.
+// (Without the read/write pin, the lcd takes the read as a write of 0xFF, a set DDRAM address 0x7F command,
+// so the caller has to clear the display or set the address counter again.)
+bool I2cCharDisplay::lcdReadable()
+{
+  sendCommand(LCD_SETDDRAMADDRCOMMAND | 0x01);
+  return (lcdRead(LCD_COMMAND) == 0x01);
+}
 
-  // put lcd in 4 bit mode again
-  data = 0x30 | _lcdBacklightControl;
-  i2cWrite1((int)(data));
-  // set the enable bit and write again
-  i2cWrite1((int)(data | LCD_ENABLEON));
-  delayMicroseconds(1);                 // hold enable high for 1us
-  // clear the enable bit and write again
-  i2cWrite1((int)(data | LCD_ENABLEOFF));
-  delayMicroseconds(1);
-  delayMicroseconds(4300);   // wait min 4.1ms
 
+// Send a command that the display carries out in a few us (set address, entry mode), without the commandDelay
+// wait. The i2c transfer of the next command, character or read gives the display the time it needs.
+// (The lcd timings don't wait after a command, the oled TIMING_US2066_SAFE waits 10ms.)
+void I2cCharDisplay::sendFastCommand(uint8_t value)
+{
+  if (_displayType == OLED_TYPE)
+  {
+    i2cWrite2(OLED_COMMANDMODE, value);
+  }
+  else
+  {
+    sendCommand(value);
+  }
+}
 
-  // set up 4 bit interface
-  data = 0x20 | _lcdBacklightControl;
-  i2cWrite1((int)(data));
-  // set the enable bit and write again
-  i2cWrite1((int)(data | LCD_ENABLEON));
-  delayMicroseconds(1);                 // hold enable high for 1us
-  // clear the enable bit and write again
-  i2cWrite1((int)(data | LCD_ENABLEOFF));
-  delayMicroseconds(1);
 
+// binary search for the shortest delay that passes the test, between 0 and delay (which has to pass)
+bool I2cCharDisplay::calibrateDelay(uint8_t test, uint16_t &delay)
+{
+  uint16_t failing = 0;
+  uint16_t working = delay;
+
+  if (!timingTests(test, working))  // the display can't be read back
+  {
+    return false;
+  }
+  if (timingTests(test, 0))
+  {
+    delay = 0;
+    return true;
+  }
+  while ((working - failing) > TIMING_CALIBRATION_STEP)
+  {
+    uint16_t middle = failing + (working - failing) / 2;
+    if (timingTests(test, middle))
+    {
+      working = middle;
+    }
+    else
+    {
+      failing = middle;
+    }
+  }
+  delay = working + working / 4;
+  return true;
+}
 
 
-  // send the function set command
-  _lcdFunctionSetCommand = LCD_4BITMODE | LCD_1LINES | LCD_5x8DOTS;
-  if (_rows > 1)
+bool I2cCharDisplay::timingTests(uint8_t test, uint16_t delay)
+{
+  for (uint8_t i = 0; i < TIMING_CALIBRATION_TRIALS; ++i)
   {
-    _lcdFunctionSetCommand |= LCD_2LINES;
+    if (!timingTrial(test, delay, i))
+    {
+      return false;
+    }
   }
-  sendCommand(LCD_FUNCTIONSETCOMMAND | _lcdFunctionSetCommand);
+  return true;
+}
 
-  // send the display command
-  // display on, no cursor and no blinking
-  _lcdDisplayControlCommand = LCD_DISPLAYON | LCD_CURSOROFF | LCD_CURSORBLINKOFF;
-  sendCommand(LCD_DISPLAYCONTROLCOMMAND | _lcdDisplayControlCommand);
 
-  // send the entry mode command
-  _lcdEntryModeCommand = LCD_DISPLAYLEFTTORIGHT | LCD_DISPLAYSHIFTOFF;
-  sendCommand(LCD_ENTRYMODECOMMAND | _lcdEntryModeCommand);
+// Write characters to the first 16 DDRAM addresses with the delay being tested, then read them back
+// with the timing that is being used now. Each pattern puts different characters in different places.
+//   TIMING_TEST_COMMAND  each character is written right after a set DDRAM address command
+//   TIMING_TEST_CLEAR    a character is written right after the clear display command
+//   TIMING_TEST_ENABLE   16 characters are written with the enable pulse being tested
+bool I2cCharDisplay::timingTrial(uint8_t test, uint16_t delay, uint8_t pattern)
+{
+  I2cCharDisplayTiming timing = _timing;
+  uint8_t expected[16];
+  uint8_t data[17];
 
-  // clear display and home cursor
-  clear();
-  home();
+  sendCommand(LCD_CLEARDISPLAYCOMMAND);
+  waitMicroseconds(timing.clearDelay);
+  memset(expected, ' ', 16);
+
+  switch (test)
+  {
+  case TIMING_TEST_COMMAND:
+    _timing.commandDelay = delay;
+    for (uint8_t i = 0; i < 8; ++i)
+    {
+      uint8_t address = ((i * 2) + pattern) & 0x0F;
+      expected[address] = 'A' + ((pattern * 8 + i) & 0x1F);
+      sendCommand(LCD_SETDDRAMADDRCOMMAND | address);
+      sendData(expected[address]);
+    }
+    break;
+
+  case TIMING_TEST_CLEAR:
+    for (uint8_t i = 0; i < 16; ++i)  // something for the clear to erase
+    {
+      sendData('#');
+    }
+    _timing.clearDelay = delay;
+    sendCommand(LCD_CLEARDISPLAYCOMMAND);
+    waitMicroseconds(delay);
+    expected[(pattern * 4) & 0x0F] = '*';
+    sendCommand(LCD_SETDDRAMADDRCOMMAND | ((pattern * 4) & 0x0F));
+    sendData('*');
+    break;
+
+  default:                          // TIMING_TEST_ENABLE
+    _timing.enablePulse = delay;
+    for (uint8_t i = 0; i < 16; ++i)
+    {
+      expected[i] = 'a' + ((i + pattern * 5) % 26);
+      sendData(expected[i]);
+    }
+    break;
+  }
+  _timing = timing;
+
+  if (!readMemory(LCD_SETDDRAMADDRCOMMAND, data, 16))
+  {
+    return false;
+  }
+  return (memcmp(data, expected, 16) == 0 || (_displayType == OLED_TYPE && memcmp(data + 1, expected, 16) == 0));
 }
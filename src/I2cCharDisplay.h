@@ -27,6 +27,41 @@
           void fadeOff();           // turns off the fade feature of the OLED
           void fadeOnce(uint8_t);   // fade out the display to off (fade time 0-16) - (on some display types, it doesn't work very well. It takes the display to half brightness and then turns off display)
           void fadeBlink(uint8_t);  // blinks the fade feature of the OLED (fade time 0-16) - (on some display types, it doesn't work very well. It takes the display to half brightness and then turns off display)
+    1.1.0 - 10/18/2026
+        Added begin(BEGIN_WARM), which probes the display and skips the full (slow) initialization
+          if the display is still configured, e.g. after a watchdog reset of the microcontroller.
+          What the rows show is read back (the first DISPLAY_WARM_COLUMNS of each row).
+        Added a snapshot of the display state, and update() which detects a display that was unplugged
+          or reset (brownout) and restores its settings, custom characters and contents. The oled and
+          an lcd that can be read keep a signature in DDRAM, which a reset erases (see displayConfigured()).
+        Added marqueeStart()/marqueeStop(), which scroll a long text through a window in one row
+          (stepped by update(), and only the characters that change are sent).
+        Added fadeBrightness(), a smooth oled brightness fade with easing curves (stepped by update()).
+        setBrightness() and the fade functions now send their commands in one i2c transmission
+          (instead of 10 commands with a 10ms delay after each), and they no longer move the cursor.
+        Added createCharacters() and createCharacters_P() (from flash), which create several custom
+          characters in one transfer and put the cursor back.
+        Added setCharset() and mapCharacter(), which print UTF-8 text (e.g. °, µ, arrows) with the
+          character codes of the lcd display ROM (HD44780 A00/A02). On an oled, CHARSET_US2066_ASCII
+          decodes UTF-8 and prints ASCII, and mapCharacter() adds the other characters. Marquees
+          that start while a charset is set are translated too.
+        print() now sends a whole string in as few i2c transmissions as possible.
+        Added the I2cCharLayer class and addLayer()/removeLayer()/compose(), for windows (status bars,
+          popups, etc.) that are composed onto the display. Only the cells that change are sent.
+        Added animationStart()/animationStop(), which play an animation (e.g. a boot splash) from flash.
+          Animations are made from text files by extras/I2cCharAnimationCompiler (run on a computer).
+        Added isrSetCell(), isrSetField() and isrRequestFlush(), which can be called from an interrupt
+          handler. They only queue the change (no i2c), and update() sends it to the display.
+        Marquees, layers, the isr queue, fields and mapCharacter() are turned off by default, so that they
+          don't take RAM. Set their sizes in I2cCharDisplay.h to use them.
+        Added setTiming() with presets for several display modules, and calibrateTiming(), which finds
+          the shortest reliable timing of a module. All of the waits in the library now come from the timing.
+        Added LCD_MCP23017_TYPE, for lcds on MCP23017 backpacks. The lcd is used in 8 bit mode, and a character
+          and its enable pulse are sent in 4 bytes of one i2c transmission.
+        Added setReferenceMode(), i2cTransactions(), readDisplayMemory() and verifyDisplay(), which the
+          I2cCharDisplayFuzz example uses to check the optimized i2c transfers against simple ones.
+        clear() now sets the entry mode back to left to right (the display does this), and doesn't shift
+          the display when it puts the signature back.
 
 
   Short Description:
@@ -41,8 +76,8 @@
 
       The library will work with **LCD** and **OLED** character displays
       (e.g. 16x2, 20x2, 20x4, etc.). The LCD displays must use the the
-      HD44780 controller chip and have a I2C PCA8574 i/o expander chip
-      on a backpack board (which gives the display I2C capability).
+      HD44780 controller chip and have a I2C PCA8574 (or MCP23017) i/o
+      expander chip on a backpack board (which gives the display I2C capability).
       OLED display modules must have the US2066 controller chip
       (which has I2C built in). Backback boards are available and
       details are in the link below.
@@ -79,10 +114,114 @@
 #include "Wire.h"
 #endif
 
+// boards that don't keep constant data in a separate flash memory space can read it directly
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#ifndef pgm_read_byte
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#endif
+#ifndef pgm_read_word
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#endif
+#ifndef pgm_read_ptr
+#define pgm_read_ptr(address) (*(const void * const *)(address))
+#endif
+
 
 // _displayType options
 #define LCD_TYPE                     0 // if the display is an LCD using the PCA8574 outputting to the HD44780 lcd controller chip
 #define OLED_TYPE                    1 // if the display is a OLED using the US2066 oled controller chip
+#define LCD_MCP23017_TYPE            2 // if the display is an LCD using the MCP23017 outputting to the HD44780 lcd controller chip (8 bit mode)
+
+// RAM used by each display object (8 bit arduino): about 270 bytes. Most of it is the snapshot of the display
+// memory, which the hot plug checks, restore() and verifyDisplay() need.
+// Marquees, layers, the isr queue, fields and mapCharacter() are turned off (their sizes, marked (*), are 0)
+// and their code is left out, so they don't take RAM in a sketch that doesn't use them. To turn one on, set its
+// size here (the Arduino IDE can't pass build flags to a library), or with a -D build flag (e.g. build_flags
+// in PlatformIO). The RAM that they add to each display object:
+//   DISPLAY_MARQUEES 14 bytes each, DISPLAY_LAYERS 2 bytes each (and 8 bytes), DISPLAY_QUEUE_SIZE 7 bytes each
+//   (and 4 bytes), DISPLAY_FIELDS 6 bytes each (and 8 bytes, they need the isr queue), DISPLAY_MAPPEDCHARACTERS
+//   3 bytes each.
+
+// size of the snapshot that is kept of the display memory (used to restore a display after it is re-attached)
+#define DISPLAY_DDRAM_SIZE           128 // covers the DDRAM addresses of the HD44780 (0x00-0x67) and the US2066 (0x00-0x7F)
+#define DISPLAY_CGRAM_SIZE           64  // 8 custom characters of 8 bytes each
+
+// most Wire libraries (Arduino, DUE, Particle) can only send 32 bytes in one transmission
+#ifndef DISPLAY_I2C_BUFFER_SIZE
+#define DISPLAY_I2C_BUFFER_SIZE      32
+#endif
+
+#define DISPLAY_PROBE_INTERVAL       500 // default time (ms) between the hot plug checks that update() makes
+
+// marquees (text that scrolls through a window in one row, see marqueeStart())
+#ifndef DISPLAY_MARQUEES
+#define DISPLAY_MARQUEES             0   // number of marquees that can run at the same time, e.g. 2 (*)
+#endif
+#define DISPLAY_MARQUEE_MAX_WIDTH    40  // widest window of a marquee
+#define MARQUEE_NONE                 0xFF // returned by marqueeStart() if all of the marquees are in use (or row,col is not on the display)
+
+// layers (windows that are composed onto the display, see addLayer())
+#ifndef DISPLAY_LAYERS
+#define DISPLAY_LAYERS               0   // number of layers that can be added to a display, e.g. 4 (*)
+#endif
+#define DISPLAY_MAX_ROWS             4   // largest display that layers can be composed on
+#define DISPLAY_MAX_COLUMNS          40
+
+// animations (made from text files by extras/I2cCharAnimationCompiler, played by animationStart())
+// An animation starts with a 5 byte header: 'C', 'A', version, rows, cols
+// followed by these records (only the characters that change from the frame before are in a frame):
+#define ANIMATION_MAGIC1             'C'
+#define ANIMATION_MAGIC2             'A'
+#define ANIMATION_VERSION            1
+#define ANIMATION_HEADERSIZE         5
+#define ANIMATION_END                0x00 // end of the animation
+#define ANIMATION_GLYPHS             0x01 // first, count, count x 8 bytes: custom characters first to first+count-1
+#define ANIMATION_CELLS              0x02 // row, col, count, count characters: characters starting at row,col (positions start at 1)
+#define ANIMATION_FRAME              0x03 // time (2 bytes, low byte first): end of a frame, show it for time ms
+
+// interrupt safe updates (see isrSetCell()), queued by an interrupt handler and sent to the display by update()
+#ifndef DISPLAY_QUEUE_SIZE
+#define DISPLAY_QUEUE_SIZE           0   // number of records in the queue (a power of 2, one of them is always kept empty), e.g. 8 (*)
+#endif
+#if DISPLAY_QUEUE_SIZE != 0 && (DISPLAY_QUEUE_SIZE < 2 || DISPLAY_QUEUE_SIZE > 256 || (DISPLAY_QUEUE_SIZE & (DISPLAY_QUEUE_SIZE - 1)) != 0)
+#error "DISPLAY_QUEUE_SIZE must be 0 or a power of 2 from 2 to 256 (the queue indexes are uint8_t and wrap with a mask)"
+#endif
+#ifndef DISPLAY_FIELDS
+#define DISPLAY_FIELDS               0   // number of fields (numbers shown at a fixed position, see defineField()), 8 at most, e.g. 4 (*)
+#endif
+#if DISPLAY_FIELDS > 8
+#error "DISPLAY_FIELDS must be 8 or less (the fields that changed are the bits of a uint8_t)"
+#endif
+#if DISPLAY_FIELDS > 0 && DISPLAY_QUEUE_SIZE == 0
+#error "DISPLAY_FIELDS needs the isr queue, set DISPLAY_QUEUE_SIZE too"
+#endif
+#define DISPLAY_FIELD_MAX_WIDTH      11  // widest field (a 32 bit number and its sign)
+#define QUEUE_CELL                   0   // queue record: row, col, character
+#define QUEUE_FIELD                  1   // queue record: field, value
+#define QUEUE_FLUSH                  2   // queue record: draw the fields now
+
+// setTiming() presets
+#define TIMING_HD44780               0 // HD44780 lcd, with the datasheet timing
+#define TIMING_HD44780_CLONE         1 // HD44780 clones (e.g. ST7066U, SPLC780D, AIP31066) with a slower oscillator, 1.5 times the datasheet timing
+#define TIMING_HD44780_SAFE          2 // the timing that this library has always used for lcds (DEFAULT for lcd)
+#define TIMING_US2066                3 // US2066 oled modules from Newhaven Display, 1ms after each command
+#define TIMING_US2066_SAFE           4 // the timing that this library has always used for oleds, 10ms after each command (DEFAULT for oled)
+
+// calibrateTiming() settings
+#define TIMING_CALIBRATION_TRIALS    4   // a timing has to pass this many read back tests in a row
+#define TIMING_CALIBRATION_STEP      10  // the binary search stops when the shortest timing is known within this many us
+#define TIMING_TEST_COMMAND          0   // the read back tests of calibrateTiming()
+#define TIMING_TEST_CLEAR            1
+#define TIMING_TEST_ENABLE           2
+
+// begin() options
+#define BEGIN_COLD                   0 // always run the full power up initialization of the display (DEFAULT)
+#define BEGIN_WARM                   1 // skip the full initialization if the display is still configured (e.g. after a watchdog reset)
+#ifndef DISPLAY_WARM_COLUMNS
+#define DISPLAY_WARM_COLUMNS         20 // columns of each row that a warm start reads back (the rest of the row is cleared)
+#endif
 
 // **********************
 // oled specific constants
@@ -90,6 +229,8 @@
 
 #define OLED_COMMANDMODE             0x80       // command value to set up command mode
 #define OLED_DATAMODE                0x40       // command value to set up data mode
+#define OLED_COMMANDSTREAM           0x00       // command value for a stream of commands (also used to read the busy flag and address counter)
+#define OLED_DATACONTINUE            0xC0       // command value for one data byte followed by another control byte
 #define OLED_SETBRIGHTNESSCOMMAND    0x81       // command address for setting the oled brightness
 #define OLED_SETFADECOMMAND          0x23       // command address for setting the fade out command
 
@@ -98,6 +239,28 @@
 #define OLED_FADEON               0X20       // command value for setting fade mode to on
 #define OLED_FADEBLINK            0X30       // command value for setting fade mode to blink
 
+// setCharset() options (how the text that is printed is changed into the character codes of the display ROM)
+#define CHARSET_RAW                  0 // bytes are sent to the display as they are (DEFAULT)
+#define CHARSET_HD44780_A00          1 // UTF-8 text, for an HD44780 lcd with the Japanese ROM (A00, the most common one)
+#define CHARSET_HD44780_A02          2 // UTF-8 text, for an HD44780 lcd with the European ROM (A02)
+#define CHARSET_US2066_ASCII         3 // UTF-8 text, for a US2066 oled (ROM A, which begin() selects): only ASCII, add other characters with mapCharacter()
+
+#ifndef DISPLAY_MAPPEDCHARACTERS
+#define DISPLAY_MAPPEDCHARACTERS     0 // number of characters that mapCharacter() can add to a charset, e.g. 8 (*)
+#endif
+
+// curves for fadeBrightness()
+#define FADE_LINEAR                  0
+#define FADE_EASEIN                  1          // starts slow, ends fast
+#define FADE_EASEOUT                 2          // starts fast, ends slow
+#define FADE_EASEINOUT               3          // starts and ends slow
+
+#define OLED_FADESTEPTIME            10         // minimum time (ms) between the brightness steps of fadeBrightness()
+
+// signature that clear() leaves in a DDRAM location that is not shown on the display (see hasSignature())
+#define DISPLAY_SIGNATURE1           0xA5
+#define DISPLAY_SIGNATURE2           0x5A
+
 // lcd specific constants
 
 // bits on the PCA8574 chip for controlling the lcd
@@ -110,6 +273,19 @@
 #define LCD_DATA            1 // Register Select bit for Data
 #define LCD_COMMAND         0 // Register Select bit for Command
 
+// MCP23017 lcd backpacks (LCD_MCP23017_TYPE): port B (GPB0-GPB7) drives the lcd data pins D0-D7, and port A
+// has the same control bits as the PCA8574 (GPA0 = RS, GPA1 = RW, GPA2 = Enable, GPA3 = backlight).
+// The registers are used with IOCON.BANK = 0 and IOCON.SEQOP = 1, so that the register address toggles
+// between GPIOB and GPIOA, and a character and its enable pulse go out in one short i2c transmission.
+// (i2c clocks up to 400kHz give the lcd the time it needs between the characters of a transmission)
+#define MCP23017_IODIRA     0x00 // register addresses
+#define MCP23017_IODIRB     0x01
+#define MCP23017_IOCON      0x0A
+#define MCP23017_GPIOA      0x12
+#define MCP23017_GPIOB      0x13
+#define MCP23017_OLATA      0x14
+#define MCP23017_SEQOP      0x20 // IOCON bit: byte mode (the register address toggles between the A and B registers)
+
 // lcd and oled constants
 
 // lcd commands
@@ -151,12 +327,30 @@
 #define LCD_SHIFTLEFT                0x00
 
 
+class I2cCharLayer;
+
+
+// The waits needed by a display module (see setTiming() and calibrateTiming()). Module vendors (and the
+// clones of the controller chips) need very different waits, so every wait in the library comes from here.
+struct I2cCharDisplayTiming
+{
+  uint16_t powerUpDelay;           // ms to wait for the display to power up, before it is initialized
+  uint16_t setupDelay;             // ms to wait during the initialization (lcd: after the backpack outputs are cleared, oled: after the setup commands)
+  uint16_t resetDelay;             // us to wait after each command that resets the lcd interface to 8 bits
+  uint16_t resyncDelay;            // us to wait after the lcd interface is reset by a warm start (see begin())
+  uint16_t commandDelay;           // us to wait after each command
+  uint16_t clearDelay;             // us to wait after the clear display command
+  uint16_t enablePulse;            // us to hold the lcd enable bit high (and then low)
+};
+
+
 class I2cCharDisplay : public Print {       // parent class is Print, so that we can use the print functions
 public:
 
   I2cCharDisplay(uint8_t displayType, uint8_t i2cAddress, uint8_t rows); // creates a display object when using the main i2c port (SDA and SCL pins)
   I2cCharDisplay(uint8_t displayType, uint8_t i2cAddress, uint8_t rows, uint8_t i2cPort); // creates a display object where you can specify the i2c port to use (0 or 1) (port 1 is for the aux i2c port using SDA1 and SCL1 pins, e.g on an Arduino DUE board)
   void begin();                                                      // required to inialize the display. run this first!
+  bool begin(uint8_t beginMode);                                     // BEGIN_COLD or BEGIN_WARM, returns true if the display was still configured and the full init was skipped
   void clear();                                                      // clear the display and home the cursor to 1,1
   void home();                                                       // move the cursor to home position (1,1)
   void cursorMove(uint8_t row, uint8_t col);                         // move cursor to position row,col (positions start at 1)
@@ -175,7 +369,39 @@ public:
   void displayShiftOn();                                             // cursor is held constant and previous characters are shifted when new ones come in
   void displayShiftOff();                                            // cursor moves after each character is received by the display (DEFAULT MODE)
   void createCharacter(uint8_t, uint8_t[]);                          // used to create custom dot matrix characters (8 are available)
+  void createCharacters(const uint8_t characterMaps[][8], uint8_t first, uint8_t count);    // create count custom characters starting at first, all in one transfer (the cursor is put back)
+  void createCharacters_P(const uint8_t characterMaps[][8], uint8_t first, uint8_t count);  // same as createCharacters(), with the character maps in flash (PROGMEM)
   virtual size_t write(uint8_t);                                     // allows the print command to work (in Arduino or Particle)
+  virtual size_t write(const uint8_t *buffer, size_t size);          // lets print() send a whole string in as few i2c transmissions as possible
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }  // (not all of Print::write(), so that write(0) still means custom character 0)
+  void setCharset(uint8_t charset);                                  // CHARSET_RAW (DEFAULT), or one of the UTF-8 charsets (e.g. CHARSET_HD44780_A00) so that characters like ° or µ print correctly
+  void mapCharacter(uint16_t codepoint, uint8_t character);          // print character (e.g. a custom character 0-7) for a unicode codepoint that the charset doesn't have
+  void update();                                                     // call this often from loop(), it checks if the display was unplugged/reset and restores it
+  void setProbeInterval(uint16_t);                                   // time in ms between the checks made by update() (0 turns the checks off)
+  bool displayAttached();                                            // returns false if the display has stopped acknowledging on the i2c bus
+  void restore();                                                    // re-initialize the display and restore its settings, custom characters and contents
+  uint8_t marqueeStart(uint8_t row, uint8_t col, uint8_t width, const char *text, uint16_t stepTime);  // scroll text through width characters starting at row,col, one step every stepTime ms (from update()), returns the marquee number
+  void marqueeStop(uint8_t marquee);                                 // stop a marquee (the text stays where it is)
+  bool addLayer(I2cCharLayer &layer);                                // add a layer that is composed onto the display, returns false if DISPLAY_LAYERS are already added
+  void removeLayer(I2cCharLayer &layer);                             // remove a layer (the cells it covered are redrawn by the next compose())
+  void compose();                                                    // send the cells that the layers changed to the display (update() does this too)
+  bool animationStart(const uint8_t *animation, bool repeat);        // play an animation (in flash, made by I2cCharAnimationCompiler) from update(), returns false if it is not an animation or is larger than the display
+  void animationStop();                                              // stop the animation (the display keeps the frame it is showing)
+  bool animationRunning();                                           // returns true while an animation is playing
+  void setTiming(uint8_t preset);                                    // use the timing of a module (TIMING_HD44780, TIMING_US2066, ...), call it before begin()
+  void setTiming(const I2cCharDisplayTiming &timing);                // use your own timing (e.g. one that calibrateTiming() found and you saved)
+  void getTiming(I2cCharDisplayTiming &timing);                      // get the timing that is being used
+  bool calibrateTiming(I2cCharDisplayTiming &timing);                // find the shortest reliable timing by reading the display back, uses it and returns it in timing (clears the display)
+  bool isrSetCell(uint8_t row, uint8_t col, uint8_t character);      // (interrupt safe) show character at row,col from the next update(), returns false if the queue is full (or turned off)
+  bool isrSetField(uint8_t field, int32_t value);                    // (interrupt safe) show value in a field from the next update(), returns false if the queue is full (or turned off)
+  bool isrRequestFlush();                                            // (interrupt safe) draw the fields at the next update(), even if the field interval has not passed
+  bool defineField(uint8_t field, uint8_t row, uint8_t col, uint8_t width);  // a field shows a number right aligned in width characters starting at row,col, returns false if row,col is not on the display
+  void setFieldInterval(uint16_t);                                   // shortest time in ms between the redraws of the fields (0 redraws them at every update(), DEFAULT)
+  uint16_t queueOverflows();                                         // number of isr...() calls that were lost because the queue was full
+  void setReferenceMode(bool);                                       // true sends every command and character in its own i2c transmission, and doesn't skip unchanged cells (for testing)
+  uint32_t i2cTransactions();                                        // number of i2c transmissions (writes and reads) made to the display
+  bool readDisplayMemory(uint8_t *ddram, uint8_t *cgram);            // read the display DDRAM (128 bytes) and CGRAM (64 bytes) back, returns false if it can't be read
+  bool verifyDisplay();                                              // returns true if the display memory matches what the library has sent to it
 
 // functions specific to lcd displays
 
@@ -188,6 +414,8 @@ public:
   void fadeOff();                                                    // turns off the fade feature of the OLED
   void fadeOnce(uint8_t);                                            // fade out the display to off (fade time 0-15) - (on some display types, it doesn't work very well. It takes the display to half brightness and then turns off display)
   void fadeBlink(uint8_t);                                           // blinks the fade feature of the OLED (fade time 0-15) - (on some display types, it doesn't work very well. It takes the display to half brightness and then turns off display)
+  void fadeBrightness(uint8_t brightness, uint16_t fadeTime, uint8_t curve);  // change the brightness smoothly over fadeTime ms (stepped by update(), doesn't wait), curve is FADE_LINEAR, FADE_EASEIN, ...
+  bool fadeBrightnessRunning();                                      // returns true until fadeBrightness() reaches its brightness
 
 
 
@@ -201,16 +429,75 @@ public:
 
 
 private:
+  friend class I2cCharLayer;
+
+  void init(uint8_t displayType, uint8_t i2cAddress, uint8_t rows, uint8_t i2cPort);  // the setup shared by the constructors
   void i2cWrite1(uint8_t data);   // write one byte to i2c bus, either i2cPort 0 or 1
   void i2cWrite2(uint8_t data1, uint8_t data2);  // write 2 bytes to the i2c bus, either i2cPort 0 or 1
+  void i2cWriteN(const uint8_t *data, uint8_t count);  // write count bytes to the i2c bus in one transmission, either i2cPort 0 or 1
+  uint8_t i2cRead(uint8_t *data, uint8_t count);  // read count bytes from the i2c bus, returns the number of bytes read
+  uint8_t i2cWriteRead(uint8_t control, uint8_t *data, uint8_t count);  // write a control byte, then read count bytes (repeated start)
   void lcdBegin();               // used to initialize the lcd display
   void oledBegin();              // used to initialize the oled display
+  void lcdWarmBegin();           // used to resume an lcd display that is still configured
+  void oledWarmBegin();          // used to resume an oled display that is still configured
+  bool lcdConfigured();          // returns true if the lcd backpack still holds the state that lcdBegin() left it in
+  bool oledConfigured();         // returns true if the oled still answers and holds the warm start signature
+  void lcdWriteNibble(uint8_t);  // write the high nibble to the lcd (used during lcd initialization)
+  void mcpBegin();               // used to initialize the lcd display on an MCP23017 backpack
+  void mcpWarmBegin();           // used to resume an lcd display on an MCP23017 backpack that is still configured
+  bool mcpConfigured();          // returns true if the MCP23017 still holds the state that mcpBegin() left it in
+  void sendMcpByte(uint8_t value, uint8_t mode);  // send a command (mode = LCD_COMMAND) or data (LCD_DATA) to the lcd on an MCP23017 backpack, in one i2c transmission
+  uint8_t mcpReadData();         // read a data byte from the lcd on an MCP23017 backpack
+  bool hasSignature();           // returns true if clear() writes the signature (the oled, and an lcd with 1 or 2 rows that can be read)
+  uint8_t signatureAddress();    // DDRAM address of the signature
+  void writeSignature();         // write the signature and return the cursor to home
+  bool signatureKept();          // returns true if the display still returns the signature (or what was printed over it)
+  bool i2cProbe();               // returns true if the display acknowledges its i2c address
+  bool displayConfigured();      // cheap check that the (attached) display has not lost its configuration
+  uint8_t ddramAddress(uint8_t row, uint8_t col);  // DDRAM address of position row,col (positions start at 1)
+  void sendDataBulk(const uint8_t *data, uint8_t count);  // send data bytes to the display in as few i2c transmissions as possible
+  void advanceAddress(bool increment);  // move the address counter of the snapshot like the display does
+  void trackData(uint8_t value);  // record a data byte (that was just sent to the display) in the snapshot
+  void replayDdram(uint8_t start, uint8_t end);  // send the snapshot of DDRAM addresses start to end-1 to the display
+  void clearSnapshot();          // set the DDRAM snapshot to what clear() leaves on the display
+  void checkDisplay();           // the hot plug check made by update()
+  void writeCells(uint8_t address, const uint8_t *data, uint8_t count);  // write count characters starting at a DDRAM address, only sending the ones that changed
+  void sendCells(uint8_t address, const uint8_t *data, uint8_t count);   // same as writeCells(), but leaves the cursor for finishCells()
+  void finishCells();            // put the entry mode and cursor back after sendCells()
+  void drawMarquee(uint8_t marquee);  // write the window of a marquee at its current position
+  uint8_t marqueeCharacter(const char *&text, bool utf8);  // returns the display character code at text, and moves text past it
+  uint8_t lineEnd(uint8_t address);  // the last DDRAM address of the row that address is in
+  void sendOledExtendedCommand(uint8_t command, uint8_t value);  // send an oled command (and its value) that needs RE=1 and SD=1, in one i2c transmission
+  void stepBrightnessFade();     // the brightness step made by update()
+  void sendCharacters(uint8_t first, uint8_t count);  // send custom characters from the CGRAM snapshot to the display
+  int16_t decodeCharacter(uint8_t value, uint32_t &codepoint, uint8_t &remaining);  // decode UTF-8 text one byte at a time (with the caller's decoder state), returns the display character code, or -1 if more bytes are needed
+  uint8_t translateCodepoint(uint32_t codepoint);  // returns the display character code for a unicode codepoint (using the charset)
+  void damage(uint8_t row, uint8_t col, uint8_t rows, uint8_t cols);  // mark an area of the display that compose() needs to redraw (positions start at 1)
+  uint8_t layerCell(uint8_t row, uint8_t col);  // the character of the top visible layer at row,col (blank if no layer covers it)
+  void stepAnimation();          // the animation frame sent by update()
+  bool queueRecord(uint8_t type, uint8_t a, uint8_t b, int32_t value);  // add a record to the isr queue (no i2c, safe in an interrupt handler)
+  void drainQueue();             // send the records of the isr queue to the display (called by update())
+  void drawField(uint8_t field); // write the value of a field
+  void waitMicroseconds(uint16_t);  // wait for one of the timing delays (longer than delayMicroseconds() can wait on some boards)
+  uint8_t lcdRead(uint8_t mode);  // read a data byte (mode = LCD_DATA) or the busy flag and address counter (LCD_COMMAND) from the lcd
+  bool readMemory(uint8_t command, uint8_t *data, uint8_t count);  // read count bytes from DDRAM or CGRAM (set by command), returns false if the display can't be read or didn't answer
+  uint8_t readOffset();          // 1 if the oled returns a dummy byte before the data it reads, 0 if not
+  bool lcdReadable();            // returns true if the lcd backpack connects the read/write pin of the lcd
+  void sendFastCommand(uint8_t); // send a set address or entry mode command, without the commandDelay wait
+  bool ddramAddressUsed(uint8_t address);  // returns true if the display has DDRAM at address
+  void readSnapshot();           // read what the rows show back into the snapshot (after a warm start)
+  bool calibrateDelay(uint8_t test, uint16_t &delay);  // binary search for the shortest delay that passes a read back test
+  bool timingTests(uint8_t test, uint16_t delay);  // returns true if delay passes TIMING_CALIBRATION_TRIALS read back tests
+  bool timingTrial(uint8_t test, uint16_t delay, uint8_t pattern);  // one read back test of a delay
   void sendCommand(uint8_t);     // send a command to the display
   void sendData(uint8_t);        // send data to the display
   void sendLcdCommand(uint8_t);  // send a command to the lcd display
   void sendLcdData(uint8_t);     // send data to the lcd display
   void sendOledCommand(uint8_t); // send a command to the oled display
   void sendOledData(uint8_t);    // send data to the oled display
+  void sendMcpCommand(uint8_t);  // send a command to the lcd display on an MCP23017 backpack
+  void sendMcpData(uint8_t);     // send data to the lcd display on an MCP23017 backpack
 
   // private variables
   // keep track of current state of these lcd commands
@@ -224,4 +511,143 @@ private:
   uint8_t _i2cPort;                 // 0 or 1, depending on which i2c port on the due is being used
   uint8_t _rows;                   // number of rows in the display (starting at 1)
   uint8_t _lcdBacklightControl;    // 0 if backlight is off, 0x08 is on
+  I2cCharDisplayTiming _timing;    // the waits that the display module needs (see setTiming())
+
+  // snapshot of the display state, so that it can be restored after the display is reset or re-attached
+  uint8_t _ddram[DISPLAY_DDRAM_SIZE];  // what has been written to the display DDRAM
+  uint8_t _cgram[DISPLAY_CGRAM_SIZE];  // what has been written to the display CGRAM (custom characters)
+  uint8_t _cgramUsed;              // one bit for each custom character that has been written
+  uint8_t _addressCounter;         // the address counter of the display (DDRAM or CGRAM address)
+  bool _addressIsCgram;            // true if the address counter points at CGRAM
+  int8_t _displayShiftCount;       // number of times the display is shifted to the right (negative is left)
+  uint8_t _oledBrightness;         // last brightness sent to the oled
+
+  bool _displayAttached;           // false when the last write to the display wasn't acknowledged
+  bool _hotPlug;                   // update() checks the display, so the writes stop while it is not attached
+  bool _displayReadable;           // false if the display can't be read back (an lcd backpack that doesn't connect the read/write pin)
+  uint16_t _probeInterval;         // time in ms between the checks made by update()
+  unsigned long _lastProbeTime;    // millis() of the last check made by update()
+
+#if DISPLAY_MARQUEES > 0
+  struct Marquee {
+    const char *text;              // the text being scrolled (it stays in the user's memory), NULL if not running
+    uint16_t length;               // length of the text (in display characters)
+    bool utf8;                     // true if the text is UTF-8 (a charset was set when it started)
+    uint16_t position;             // index of the text that is at the left edge of the window
+    uint8_t address;               // DDRAM address of the left edge of the window
+    uint8_t width;                 // width of the window
+    uint16_t stepTime;             // time in ms between steps
+    unsigned long lastStepTime;    // millis() of the last step
+  };
+  Marquee _marquees[DISPLAY_MARQUEES];
+#endif
+  bool _cellsSent;                 // true if sendCells() moved the cursor (and finishCells() needs to put it back)
+
+  // UTF-8 translation (see setCharset())
+  uint8_t _charset;
+  uint32_t _utf8Codepoint;         // codepoint being decoded
+  uint8_t _utf8Remaining;          // number of UTF-8 continuation bytes still needed
+#if DISPLAY_MAPPEDCHARACTERS > 0
+  uint16_t _mappedCodepoints[DISPLAY_MAPPEDCHARACTERS];  // codepoints added by mapCharacter() (0 is not used)
+  uint8_t _mappedCharacters[DISPLAY_MAPPEDCHARACTERS];   // the character codes for those codepoints
+#endif
+
+#if DISPLAY_LAYERS > 0
+  // layers (see addLayer())
+  I2cCharLayer *_layers[DISPLAY_LAYERS];
+  uint8_t _damageLeft[DISPLAY_MAX_ROWS];   // first column of each row that compose() needs to redraw
+  uint8_t _damageRight[DISPLAY_MAX_ROWS];  // last column of each row that compose() needs to redraw (0 if none)
+#endif
+
+  // animation (see animationStart())
+  const uint8_t *_animation;       // start of the animation (in flash), NULL if none is playing
+  const uint8_t *_animationNext;   // next record to play
+  bool _animationRepeat;
+  uint16_t _animationFrameTime;    // time in ms to show the current frame
+  unsigned long _animationFrameStart;  // millis() when the current frame was sent
+
+#if DISPLAY_QUEUE_SIZE > 0
+  // isr queue (see isrSetCell()), a ring that one interrupt handler writes and update() reads, without locks
+  struct QueueRecord {
+    uint8_t type;                  // QUEUE_CELL, QUEUE_FIELD or QUEUE_FLUSH
+    uint8_t a;                     // row (cell) or field number (field)
+    uint8_t b;                     // column (cell)
+    int32_t value;                 // character (cell) or value (field)
+  };
+  QueueRecord _queue[DISPLAY_QUEUE_SIZE];
+  volatile uint8_t _queueHead;     // next record to write (only changed by the interrupt handler)
+  volatile uint8_t _queueTail;     // next record to read (only changed by update())
+  volatile uint16_t _queueOverflows;  // records lost because the queue was full (only changed by the interrupt handler)
+#endif
+
+#if DISPLAY_FIELDS > 0
+  struct Field {
+    uint8_t address;               // DDRAM address of the first character
+    uint8_t width;                 // 0 if the field is not defined
+    int32_t value;
+  };
+  Field _fields[DISPLAY_FIELDS];
+  uint8_t _fieldsChanged;          // one bit for each field with a value that has not been drawn yet
+  bool _fieldsFlush;               // true if isrRequestFlush() asked to draw the fields now
+  uint16_t _fieldInterval;         // shortest time in ms between the redraws of the fields
+  unsigned long _fieldDrawTime;    // millis() when the fields were last drawn
+#endif
+
+  bool _referenceMode;             // true sends everything one byte at a time (see setReferenceMode())
+  uint32_t _i2cTransactions;       // i2c transmissions made to the display
+
+  // brightness fade (see fadeBrightness())
+  bool _fadeRunning;
+  uint8_t _fadeStartBrightness;
+  uint8_t _fadeEndBrightness;
+  uint8_t _fadeCurve;
+  uint16_t _fadeTime;
+  unsigned long _fadeStartTime;    // millis() when the fade started
+  unsigned long _fadeStepTime;     // millis() of the last brightness step
+};
+
+
+// A layer is a window of characters (e.g. a status bar, a main area, or a popup) that is composed
+// onto the display by I2cCharDisplay::compose(). Where layers overlap, the one with the highest z is shown.
+// The characters are kept in a buffer that you provide (rows * cols bytes), so nothing is allocated, e.g.
+//   uint8_t popupBuffer[2 * 12];
+//   I2cCharLayer popup(popupBuffer, 2, 12);
+// Print to a layer like you would to the display. Only the cells that change are sent to the display,
+// and when a layer is hidden, only the cells it covered are redrawn.
+class I2cCharLayer : public Print {
+public:
+
+  I2cCharLayer(uint8_t *buffer, uint8_t rows, uint8_t cols);        // creates a layer of rows x cols characters, buffer must hold rows * cols bytes
+  void setPosition(uint8_t row, uint8_t col);                        // move the top left corner of the layer to row,col of the display (positions start at 1)
+  void setZ(uint8_t z);                                              // layers with a higher z are shown on top (DEFAULT 0)
+  void show();                                                       // show the layer (DEFAULT)
+  void hide();                                                       // hide the layer, the layers under it are shown again
+  bool visible();                                                    // returns true if the layer is shown
+  void clear();                                                      // fill the layer with blanks and move the layer cursor to 1,1
+  void cursorMove(uint8_t row, uint8_t col);                         // move the layer cursor to row,col of the layer (positions start at 1)
+  void setCell(uint8_t row, uint8_t col, uint8_t character);         // put one character at row,col of the layer (positions start at 1)
+  virtual size_t write(uint8_t);                                     // allows the print command to work, '\n' moves to the start of the next row
+
+private:
+  friend class I2cCharDisplay;
+
+  void markDirty(uint8_t row, uint8_t col);   // note a changed cell (positions start at 0)
+  void damageArea();             // tell the display that the whole area of the layer needs to be redrawn
+
+  uint8_t *_buffer;              // rows * cols characters
+  uint8_t _rows;
+  uint8_t _cols;
+  uint8_t _row;                  // position of the top left corner on the display (starting at 1)
+  uint8_t _col;
+  uint8_t _z;
+  bool _visible;
+  uint8_t _cursorRow;            // where write() puts the next character (starting at 0)
+  uint8_t _cursorCol;
+  uint32_t _utf8Codepoint;       // the layer's own UTF-8 decoder state (see I2cCharDisplay::decodeCharacter())
+  uint8_t _utf8Remaining;
+  uint8_t _dirtyTop;             // area of the layer that changed since the last compose() (starting at 0, top > bottom if none)
+  uint8_t _dirtyBottom;
+  uint8_t _dirtyLeft;
+  uint8_t _dirtyRight;
+  I2cCharDisplay *_display;      // the display the layer was added to (NULL if none)
 };